@@ -0,0 +1,15 @@
+#version 430 core
+out vec4 FragColor;
+
+// the textures of the command group, see IndirectBatch.h
+layout (binding = 0) uniform sampler2D texture_diffuse;
+layout (binding = 1) uniform sampler2D texture_specular;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+void main()
+{
+    FragColor = texture(texture_diffuse, TexCoords);
+}
\ No newline at end of file
@@ -1,3 +1,4 @@
+#version 330 core
 out vec4 FragColor;
 
 uniform sampler2D texture_diffuse1;
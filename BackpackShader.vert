@@ -2,19 +2,41 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance, see InstanceBuffer.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
+
+// undo the quantization of PackedVertex, identity for float vertices (see VertexFormat.h)
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+vec3 decodeNormal(vec3 n)
+{
+    if (!octahedralNormals)
+        return n;
+    vec3 unfolded = vec3(n.xy, 1.0 - abs(n.x) - abs(n.y));
+    float t = max(-unfolded.z, 0.0);
+    unfolded.xy += vec2(unfolded.x >= 0.0 ? -t : t, unfolded.y >= 0.0 ? -t : t);
+    return normalize(unfolded);
+}
+
 void main()
 {
-    FragPos = aPos;
-    Normal = aNormal;
+    vec4 worldPos = aModel * vec4(positionOffset + aPos * positionScale, 1.0);
+    FragPos = vec3(worldPos);
+    Normal = aNormalMatrix * decodeNormal(aNormal);
     TexCoords = aTexCoords;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * worldPos;
 } 
\ No newline at end of file
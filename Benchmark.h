@@ -0,0 +1,488 @@
+#pragma once
+
+// Deterministic benchmark mode: a recorded (or generated) camera path is replayed
+// at a fixed timestep and per-frame CPU time, GPU time and draw calls are written
+// out as JSON, so runs on different commits can be compared directly.
+
+#include <glad/glad.h>
+
+#include <glm.hpp>
+
+#include "Camera.h"
+#include "RenderStats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#endif
+
+enum Benchmark_Scene {
+    SCENE_CUBES,
+    SCENE_BACKPACK,
+    SCENE_INSTANCES
+};
+
+struct BenchmarkOptions
+{
+    bool Enabled = false;
+    Benchmark_Scene Scene = SCENE_CUBES;
+    // 0 picks the scene default, see InstanceCount
+    unsigned int Instances = 0;
+    unsigned int Frames = 1000;
+    unsigned int WarmupFrames = 30;
+    float Timestep = 1.0f / 60.0f;
+    bool CompressTextures = true;
+    bool FrustumCulling = true;
+    // multi-draw indirect for models where the context supports it (GL 4.3)
+    bool IndirectDraw = true;
+    // 16 byte quantized vertices for models instead of 32 byte floats, see VertexFormat.h
+    bool PackedVertices = false;
+    // coarser model LODs for copies that are small on screen
+    bool LevelOfDetail = true;
+    // meshlet frustum and back-face culling for models drawn at full detail, see ClusterCuller.h
+    bool ClusterCulling = true;
+    // keep the CPU copies of model geometry after upload, see Model
+    bool KeepGeometry = false;
+    // reuse linked shader binaries from earlier runs, see ProgramCache.h
+    bool ProgramBinaryCache = true;
+    // compile shaders in the background and check them on first use, see Shader::AsyncCompile
+    bool AsyncShaders = true;
+    // order draws by state and depth through a RenderQueue, see RenderQueue.h
+    bool DrawSort = true;
+    // depth-only pass before the lighting shader of the cube scenes
+    bool DepthPrepass = false;
+    // lights of the cube scenes, which pick their shader variant from them
+    unsigned int PointLights = 4;
+    bool Flashlight = true;
+    std::string CameraPath;
+    std::string RecordPath;
+    std::string Output;
+
+    // --benchmark --scene cubes|backpack|instances --instances N --frames N --warmup N
+    // --timestep S --camera-path FILE --record-path FILE --output FILE --no-texture-compression
+    // --no-culling --no-indirect --packed-vertices --no-lod --no-cluster-culling --keep-geometry
+    // --no-program-cache --point-lights N --no-flashlight --no-async-shaders --no-draw-sort
+    // --depth-prepass
+    static BenchmarkOptions Parse(int argc, char** argv)
+    {
+        BenchmarkOptions options;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--benchmark")
+                options.Enabled = true;
+            else if (arg == "--scene" && hasValue)
+            {
+                std::string scene = argv[++i];
+                if (scene == "backpack")
+                    options.Scene = SCENE_BACKPACK;
+                else if (scene == "instances")
+                    options.Scene = SCENE_INSTANCES;
+                else if (scene == "cubes")
+                    options.Scene = SCENE_CUBES;
+                else
+                    std::cout << "Unknown scene " << scene << ", using cubes" << std::endl;
+            }
+            else if (arg == "--instances" && hasValue)
+                options.Instances = static_cast<unsigned int>(std::stoul(argv[++i]));
+            else if (arg == "--frames" && hasValue)
+                options.Frames = static_cast<unsigned int>(std::stoul(argv[++i]));
+            else if (arg == "--warmup" && hasValue)
+                options.WarmupFrames = static_cast<unsigned int>(std::stoul(argv[++i]));
+            else if (arg == "--timestep" && hasValue)
+                options.Timestep = std::stof(argv[++i]);
+            else if (arg == "--camera-path" && hasValue)
+                options.CameraPath = argv[++i];
+            else if (arg == "--record-path" && hasValue)
+                options.RecordPath = argv[++i];
+            else if (arg == "--output" && hasValue)
+                options.Output = argv[++i];
+            else if (arg == "--no-texture-compression")
+                options.CompressTextures = false;
+            else if (arg == "--no-culling")
+                options.FrustumCulling = false;
+            else if (arg == "--no-indirect")
+                options.IndirectDraw = false;
+            else if (arg == "--packed-vertices")
+                options.PackedVertices = true;
+            else if (arg == "--no-lod")
+                options.LevelOfDetail = false;
+            else if (arg == "--no-cluster-culling")
+                options.ClusterCulling = false;
+            else if (arg == "--keep-geometry")
+                options.KeepGeometry = true;
+            else if (arg == "--no-program-cache")
+                options.ProgramBinaryCache = false;
+            else if (arg == "--point-lights" && hasValue)
+                options.PointLights = std::min(static_cast<unsigned int>(std::stoul(argv[++i])), 4u);
+            else if (arg == "--no-flashlight")
+                options.Flashlight = false;
+            else if (arg == "--no-async-shaders")
+                options.AsyncShaders = false;
+            else if (arg == "--no-draw-sort")
+                options.DrawSort = false;
+            else if (arg == "--depth-prepass")
+                options.DepthPrepass = true;
+        }
+        return options;
+    }
+
+    // copies drawn by the instanced scenes: a grid of cubes, or a row of backpacks
+    unsigned int InstanceCount() const
+    {
+        if (Instances)
+            return Instances;
+        return Scene == SCENE_INSTANCES ? 10000 : 1;
+    }
+
+    const char* SceneName() const
+    {
+        switch (Scene)
+        {
+        case SCENE_BACKPACK: return "backpack";
+        case SCENE_INSTANCES: return "instances";
+        default: return "cubes";
+        }
+    }
+};
+
+struct CameraKeyframe
+{
+    float Time;
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+    float Zoom;
+};
+
+// Text format, one keyframe per line: time x y z yaw pitch zoom
+class CameraPath
+{
+public:
+    std::vector<CameraKeyframe> Keyframes;
+
+    bool Load(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::BENCHMARK::CAMERA_PATH_NOT_FOUND " << path << std::endl;
+            return false;
+        }
+        Keyframes.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream stream(line);
+            CameraKeyframe key;
+            if (stream >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z >> key.Yaw >> key.Pitch >> key.Zoom)
+                Keyframes.push_back(key);
+        }
+        return !Keyframes.empty();
+    }
+
+    bool Save(const std::string& path) const
+    {
+        std::ofstream file(path);
+        if (!file)
+            return false;
+        file << "# time x y z yaw pitch zoom\n";
+        for (const CameraKeyframe& key : Keyframes)
+        {
+            file << key.Time << ' ' << key.Position.x << ' ' << key.Position.y << ' ' << key.Position.z << ' '
+                << key.Yaw << ' ' << key.Pitch << ' ' << key.Zoom << '\n';
+        }
+        return true;
+    }
+
+    void Record(float time, const Camera& camera)
+    {
+        Keyframes.push_back({ time, camera.Position, camera.Yaw, camera.Pitch, camera.Zoom });
+    }
+
+    // deterministic fallback when no recording is given: one slow orbit around the origin
+    void GenerateOrbit(float radius, float height, float duration)
+    {
+        Keyframes.clear();
+        const unsigned int steps = 64;
+        for (unsigned int i = 0; i <= steps; ++i)
+        {
+            float t = static_cast<float>(i) / steps;
+            float angle = glm::radians(360.0f * t);
+            glm::vec3 position(radius * sinf(angle), height, radius * cosf(angle));
+            glm::vec3 dir = glm::normalize(-position);
+            float yaw = glm::degrees(atan2f(dir.z, dir.x));
+            float pitch = glm::degrees(asinf(dir.y));
+            Keyframes.push_back({ t * duration, position, yaw, pitch, ZOOM });
+        }
+    }
+
+    float Duration() const
+    {
+        return Keyframes.empty() ? 0.0f : Keyframes.back().Time;
+    }
+
+    // positions the camera at time t, interpolating linearly and looping past the end
+    void Apply(float t, Camera& camera) const
+    {
+        if (Keyframes.empty())
+            return;
+        float duration = Duration();
+        if (duration > 0.0f)
+            t = fmodf(t, duration);
+
+        auto next = std::upper_bound(Keyframes.begin(), Keyframes.end(), t,
+            [](float time, const CameraKeyframe& key) { return time < key.Time; });
+        if (next == Keyframes.begin() || next == Keyframes.end())
+        {
+            const CameraKeyframe& key = next == Keyframes.end() ? Keyframes.back() : Keyframes.front();
+            camera.SetPose(key.Position, key.Yaw, key.Pitch, key.Zoom);
+            return;
+        }
+        const CameraKeyframe& a = *(next - 1);
+        const CameraKeyframe& b = *next;
+        float span = b.Time - a.Time;
+        float f = span > 0.0f ? (t - a.Time) / span : 0.0f;
+        // yaw along the shorter arc, so a key wrapping from -180 to 180 degrees doesn't spin the camera around
+        float yawDelta = fmodf(b.Yaw - a.Yaw, 360.0f);
+        if (yawDelta > 180.0f)
+            yawDelta -= 360.0f;
+        else if (yawDelta < -180.0f)
+            yawDelta += 360.0f;
+        camera.SetPose(glm::mix(a.Position, b.Position, f), a.Yaw + yawDelta * f,
+            glm::mix(a.Pitch, b.Pitch, f), glm::mix(a.Zoom, b.Zoom, f));
+    }
+};
+
+// resident set size of the process, now and at its peak; zero where it can't be queried
+struct ProcessMemory
+{
+    uint64_t ResidentBytes = 0;
+    uint64_t PeakResidentBytes = 0;
+
+    static ProcessMemory Query()
+    {
+        ProcessMemory memory;
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            memory.ResidentBytes = counters.WorkingSetSize;
+            memory.PeakResidentBytes = counters.PeakWorkingSetSize;
+        }
+#else
+        // VmRSS and VmHWM are reported in kB
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line))
+        {
+            if (line.rfind("VmRSS:", 0) == 0)
+                memory.ResidentBytes = std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+            else if (line.rfind("VmHWM:", 0) == 0)
+                memory.PeakResidentBytes = std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+#endif
+        return memory;
+    }
+};
+
+struct FrameSample
+{
+    double CpuMs;
+    double FrameMs;
+    double GpuMs;
+    unsigned int DrawCalls;
+    unsigned int Submitted;
+    unsigned int Culled;
+    unsigned int Triangles;
+    unsigned int ClustersCulled;
+    unsigned int StateCalls;
+    unsigned int StateCallsFiltered;
+};
+
+// Collects per-frame samples; GPU time comes from GL_TIME_ELAPSED queries that are
+// only read back once the run is over, so querying never stalls the pipeline.
+class BenchmarkRecorder
+{
+public:
+    std::vector<FrameSample> Samples;
+
+    void Begin(unsigned int frames)
+    {
+        Samples.clear();
+        Samples.reserve(frames);
+        queries.resize(frames);
+        if (frames)
+            glGenQueries(frames, queries.data());
+    }
+
+    void BeginFrame()
+    {
+        frameStart = std::chrono::steady_clock::now();
+        if (Samples.size() < queries.size())
+            glBeginQuery(GL_TIME_ELAPSED, queries[Samples.size()]);
+    }
+
+    // submitted marks the point where the CPU has issued all GL work for the frame
+    void EndSubmission()
+    {
+        submitted = std::chrono::steady_clock::now();
+        if (Samples.size() < queries.size())
+            glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    void EndFrame(const RenderStats& stats)
+    {
+        auto end = std::chrono::steady_clock::now();
+        FrameSample sample;
+        sample.CpuMs = std::chrono::duration<double, std::milli>(submitted - frameStart).count();
+        sample.FrameMs = std::chrono::duration<double, std::milli>(end - frameStart).count();
+        sample.GpuMs = 0.0;
+        sample.DrawCalls = stats.DrawCalls;
+        sample.Submitted = stats.Submitted;
+        sample.Culled = stats.Culled;
+        sample.Triangles = stats.Triangles;
+        sample.ClustersCulled = stats.ClustersCulled;
+        sample.StateCalls = stats.StateCalls;
+        sample.StateCallsFiltered = stats.StateCallsFiltered;
+        Samples.push_back(sample);
+    }
+
+    void Finish()
+    {
+        for (size_t i = 0; i < Samples.size(); ++i)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+            Samples[i].GpuMs = static_cast<double>(elapsed) / 1.0e6;
+        }
+        if (!queries.empty())
+            glDeleteQueries(static_cast<GLsizei>(queries.size()), queries.data());
+        queries.clear();
+        memory = ProcessMemory::Query();
+    }
+
+    void WriteJson(std::ostream& out, const BenchmarkOptions& options, double loadTimeMs) const
+    {
+        out << "{\n";
+        out << "  \"scene\": \"" << options.SceneName() << "\",\n";
+        if (options.Scene != SCENE_CUBES)
+            out << "  \"instances\": " << options.InstanceCount() << ",\n";
+        out << "  \"frames\": " << Samples.size() << ",\n";
+        out << "  \"warmupFrames\": " << options.WarmupFrames << ",\n";
+        out << "  \"timestep\": " << options.Timestep << ",\n";
+        out << "  \"textureCompression\": " << (options.CompressTextures ? "true" : "false") << ",\n";
+        out << "  \"frustumCulling\": " << (options.FrustumCulling ? "true" : "false") << ",\n";
+        out << "  \"indirectDraw\": " << (options.IndirectDraw ? "true" : "false") << ",\n";
+        out << "  \"packedVertices\": " << (options.PackedVertices ? "true" : "false") << ",\n";
+        out << "  \"levelOfDetail\": " << (options.LevelOfDetail ? "true" : "false") << ",\n";
+        out << "  \"clusterCulling\": " << (options.ClusterCulling ? "true" : "false") << ",\n";
+        out << "  \"keepGeometry\": " << (options.KeepGeometry ? "true" : "false") << ",\n";
+        out << "  \"programCache\": " << (options.ProgramBinaryCache ? "true" : "false") << ",\n";
+        out << "  \"asyncShaders\": " << (options.AsyncShaders ? "true" : "false") << ",\n";
+        out << "  \"drawSort\": " << (options.DrawSort ? "true" : "false") << ",\n";
+        if (options.Scene != SCENE_BACKPACK)
+        {
+            out << "  \"pointLights\": " << options.PointLights << ",\n";
+            out << "  \"flashlight\": " << (options.Flashlight ? "true" : "false") << ",\n";
+            out << "  \"depthPrepass\": " << (options.DepthPrepass ? "true" : "false") << ",\n";
+        }
+        out << "  \"renderer\": \"" << glString(GL_RENDERER) << "\",\n";
+        out << "  \"glVersion\": \"" << glString(GL_VERSION) << "\",\n";
+        out << "  \"loadTimeMs\": " << loadTimeMs << ",\n";
+        // at the end of the run, i.e. steady state, and the peak, which is usually the import
+        out << "  \"residentMB\": " << memory.ResidentBytes / (1024.0 * 1024.0) << ",\n";
+        out << "  \"peakResidentMB\": " << memory.PeakResidentBytes / (1024.0 * 1024.0) << ",\n";
+        writeStats(out, "cpuMs", [](const FrameSample& s) { return s.CpuMs; });
+        writeStats(out, "frameMs", [](const FrameSample& s) { return s.FrameMs; });
+        writeStats(out, "gpuMs", [](const FrameSample& s) { return s.GpuMs; });
+        writeStats(out, "drawCalls", [](const FrameSample& s) { return static_cast<double>(s.DrawCalls); });
+        writeStats(out, "submitted", [](const FrameSample& s) { return static_cast<double>(s.Submitted); });
+        writeStats(out, "culled", [](const FrameSample& s) { return static_cast<double>(s.Culled); });
+        writeStats(out, "triangles", [](const FrameSample& s) { return static_cast<double>(s.Triangles); });
+        writeStats(out, "clustersCulled", [](const FrameSample& s) { return static_cast<double>(s.ClustersCulled); });
+        writeStats(out, "stateCalls", [](const FrameSample& s) { return static_cast<double>(s.StateCalls); });
+        writeStats(out, "stateCallsFiltered", [](const FrameSample& s) { return static_cast<double>(s.StateCallsFiltered); });
+        out << "  \"samples\": [\n";
+        for (size_t i = 0; i < Samples.size(); ++i)
+        {
+            const FrameSample& s = Samples[i];
+            out << "    {\"cpuMs\": " << s.CpuMs << ", \"frameMs\": " << s.FrameMs << ", \"gpuMs\": " << s.GpuMs
+                << ", \"drawCalls\": " << s.DrawCalls << ", \"submitted\": " << s.Submitted
+                << ", \"culled\": " << s.Culled << ", \"triangles\": " << s.Triangles
+                << ", \"clustersCulled\": " << s.ClustersCulled << ", \"stateCalls\": " << s.StateCalls
+                << ", \"stateCallsFiltered\": " << s.StateCallsFiltered << "}" << (i + 1 < Samples.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n";
+        out << "}\n";
+    }
+
+private:
+    std::vector<GLuint> queries;
+    std::chrono::steady_clock::time_point frameStart;
+    std::chrono::steady_clock::time_point submitted;
+    ProcessMemory memory;
+
+    static std::string glString(GLenum name)
+    {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        std::string result = value ? value : "";
+        result.erase(std::remove(result.begin(), result.end(), '"'), result.end());
+        return result;
+    }
+
+    static double percentile(const std::vector<double>& sorted, double p)
+    {
+        if (sorted.empty())
+            return 0.0;
+        double rank = p * (sorted.size() - 1);
+        size_t lo = static_cast<size_t>(rank);
+        size_t hi = std::min(lo + 1, sorted.size() - 1);
+        return sorted[lo] + (sorted[hi] - sorted[lo]) * (rank - lo);
+    }
+
+    template <typename Getter>
+    void writeStats(std::ostream& out, const char* name, Getter get) const
+    {
+        std::vector<double> values;
+        values.reserve(Samples.size());
+        double sum = 0.0;
+        for (const FrameSample& s : Samples)
+        {
+            values.push_back(get(s));
+            sum += values.back();
+        }
+        std::sort(values.begin(), values.end());
+        double mean = values.empty() ? 0.0 : sum / values.size();
+        out << "  \"" << name << "\": {\"mean\": " << mean
+            << ", \"min\": " << (values.empty() ? 0.0 : values.front())
+            << ", \"p50\": " << percentile(values, 0.50)
+            << ", \"p95\": " << percentile(values, 0.95)
+            << ", \"p99\": " << percentile(values, 0.99)
+            << ", \"max\": " << (values.empty() ? 0.0 : values.back()) << "},\n";
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// axis aligned box, in mesh space unless noted otherwise
+struct Bounds
+{
+    glm::vec3 Min = glm::vec3(0.0f);
+    glm::vec3 Max = glm::vec3(0.0f);
+
+    glm::vec3 Center() const
+    {
+        return (Min + Max) * 0.5f;
+    }
+
+    // radius of the sphere around Center enclosing the box
+    float Radius() const
+    {
+        return glm::length(Max - Min) * 0.5f;
+    }
+
+    // box enclosing this one after a transform (Arvo's method)
+    Bounds Transformed(const glm::mat4& transform) const
+    {
+        Bounds result;
+        result.Min = result.Max = glm::vec3(transform[3]);
+        for (int column = 0; column < 3; ++column)
+        {
+            for (int row = 0; row < 3; ++row)
+            {
+                float a = transform[column][row] * Min[column];
+                float b = transform[column][row] * Max[column];
+                result.Min[row] += std::min(a, b);
+                result.Max[row] += std::max(a, b);
+            }
+        }
+        return result;
+    }
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Camera.h"
+#include "Frustum.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+
+#include <vector>
+
+// Culls the meshlets of one mesh instance against the view frustum and, when back faces are
+// culled anyway, against their normal cones, so a partly visible mesh only submits the
+// clusters that can contribute. Tests run in mesh space: the camera and the frustum planes are
+// brought into it once per instance instead of moving every bound out.
+// A default constructed culler is disabled.
+struct ClusterCuller
+{
+    bool Enabled = false;
+    Frustum ViewFrustum;
+    glm::vec3 CameraPosition = glm::vec3(0.0f);
+    // only valid with GL_CULL_FACE on and back faces culled
+    bool BackfaceCulling = false;
+
+    static ClusterCuller FromCamera(const Camera& camera, const Frustum& frustum, bool backfaceCulling)
+    {
+        ClusterCuller culler;
+        culler.Enabled = true;
+        culler.ViewFrustum = frustum;
+        culler.CameraPosition = camera.Position;
+        culler.BackfaceCulling = backfaceCulling;
+        return culler;
+    }
+
+    // replaces visible with the index ranges of the meshlets that survive, adjacent ones merged
+    void Cull(const std::vector<Meshlet>& meshlets, const glm::mat4& model, std::vector<IndexRange>& visible) const
+    {
+        visible.clear();
+        // a plane p transforms to transpose(model) * p; normalizing it again keeps the sphere
+        // test exact for the mesh space spheres, even under non-uniform scale
+        glm::vec4 planes[6];
+        glm::mat4 transposed = glm::transpose(model);
+        for (int i = 0; i < 6; ++i)
+        {
+            planes[i] = transposed * ViewFrustum.Planes[i];
+            float length = glm::length(glm::vec3(planes[i]));
+            if (length > 0.0f)
+                planes[i] /= length;
+        }
+        // affine transforms keep which side of a plane a point is on, so the cone test holds
+        // in mesh space too
+        glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(CameraPosition, 1.0f));
+
+        unsigned int culled = 0;
+        for (const Meshlet& meshlet : meshlets)
+        {
+            if (!visibleInFrustum(planes, meshlet) || (BackfaceCulling && facesAway(camera, meshlet)))
+            {
+                ++culled;
+                continue;
+            }
+            if (!visible.empty() && visible.back().FirstIndex + visible.back().IndexCount == meshlet.FirstIndex)
+                visible.back().IndexCount += meshlet.IndexCount;
+            else
+                visible.push_back({ meshlet.FirstIndex, meshlet.IndexCount });
+        }
+        renderStats.ClustersSubmitted += static_cast<unsigned int>(meshlets.size()) - culled;
+        renderStats.ClustersCulled += culled;
+    }
+
+private:
+    static bool visibleInFrustum(const glm::vec4 (&planes)[6], const Meshlet& meshlet)
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), meshlet.Center) + plane.w < -meshlet.Radius)
+                return false;
+        }
+        return true;
+    }
+
+    // the whole sphere sees only the back of the cone's triangles
+    static bool facesAway(const glm::vec3& camera, const Meshlet& meshlet)
+    {
+        glm::vec3 offset = meshlet.Center - camera;
+        return glm::dot(offset, meshlet.ConeAxis) >= meshlet.ConeCutoff * glm::length(offset) + meshlet.Radius;
+    }
+};
@@ -1,4 +1,13 @@
 #version 330 core
+// ShaderVariants compiles this with LIGHTING_FEATURES and only the features a draw needs:
+// DIR_LIGHT, SPOT_LIGHT, EMISSION_MAP and POINT_LIGHTS <count>. On its own it evaluates
+// everything, looping over pointLightCount.
+#ifndef LIGHTING_FEATURES
+#define DIR_LIGHT
+#define SPOT_LIGHT
+#define EMISSION_MAP
+#endif
+
 struct Material {
     sampler2D diffuse;
     sampler2D specular;
@@ -6,6 +15,7 @@ struct Material {
     float shininess;
 }; 
 
+// member order mirrors the std140 structs in UniformBuffer.h
 struct DirLight {
     vec3 direction;
 
@@ -13,41 +23,42 @@ struct DirLight {
     vec3 diffuse;
     vec3 specular;
 };
-uniform DirLight dirLight;
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 
 struct PointLight {
     vec3 position;
-
     float constant;
-    float linear;
-    float quadratic;
-
     vec3 ambient;
+    float linear;
     vec3 diffuse;
+    float quadratic;
     vec3 specular;
 };
-#define NR_POINT_LIGHTS 4  
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 struct SpotLight {
     vec3 position;
-    vec3 direction;
     float cutOff;
+    vec3 direction;
     float outerCutOff;
-  
     vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
     float constant;
+    vec3 diffuse;
     float linear;
+    vec3 specular;
     float quadratic;
 };
-uniform SpotLight spotLight;
 vec3 CalcSpotLight(SpotLight spotLight, vec3 normal, vec3 fragPos, vec3 viewDir);
 
+#define MAX_POINT_LIGHTS 16
+layout (std140) uniform Lights
+{
+    DirLight dirLight;
+    SpotLight spotLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    int pointLightCount;
+};
+
 uniform Material material;
 
 in vec3 FragPos;
@@ -64,13 +75,24 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(-FragPos);
 
-    vec3 outputColor = CalcDirLight(dirLight, norm, viewDir);
+    vec3 outputColor = vec3(0.0);
+#ifdef DIR_LIGHT
+    outputColor += CalcDirLight(dirLight, norm, viewDir);
+#endif
+#ifdef SPOT_LIGHT
     outputColor += CalcSpotLight(spotLight, norm, FragPos, viewDir);
-    for(int i = 0; i < NR_POINT_LIGHTS; ++i)
+#endif
+#ifdef POINT_LIGHTS
+    // a constant trip count the compiler can unroll, or drop entirely at 0
+    for(int i = 0; i < POINT_LIGHTS; ++i)
+#else
+    for(int i = 0; i < pointLightCount; ++i)
+#endif
     {
         outputColor += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
     }
 
+#ifdef EMISSION_MAP
     vec3 emissionColor = vec3(texture(material.emission, TexCoords));
     emissionColor.r = emissionColor.g;
     emissionColor.b = emissionColor.g;
@@ -80,6 +102,7 @@ void main()
         emissionColor = vec3(0.0f, 0.0f, 0.0f);
     }
     outputColor += emissionColor;
+#endif
    
 
     float ndc = gl_FragCoord.z * 2.0 - 1.0;
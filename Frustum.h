@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Bounds.h"
+
+// View frustum as six inward facing planes (xyz normal, w distance), extracted from a
+// projection * view matrix, so tests run in world space.
+class Frustum
+{
+public:
+    glm::vec4 Planes[6];
+
+    // a frustum that contains everything, used when culling is switched off
+    Frustum()
+    {
+        for (glm::vec4& plane : Planes)
+            plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        // glm is column major, so row i of the matrix is m[0][i], m[1][i], m[2][i], m[3][i]
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; ++i)
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        Planes[0] = rows[3] + rows[0]; // left
+        Planes[1] = rows[3] - rows[0]; // right
+        Planes[2] = rows[3] + rows[1]; // bottom
+        Planes[3] = rows[3] - rows[1]; // top
+        Planes[4] = rows[3] + rows[2]; // near
+        Planes[5] = rows[3] - rows[2]; // far
+        for (glm::vec4& plane : Planes)
+            plane /= glm::length(glm::vec3(plane));
+    }
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (const glm::vec4& plane : Planes)
+        {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // tests the corner furthest along each plane normal, conservative near the frustum edges
+    bool IntersectsBox(const Bounds& box) const
+    {
+        for (const glm::vec4& plane : Planes)
+        {
+            glm::vec3 corner(plane.x >= 0.0f ? box.Max.x : box.Min.x,
+                plane.y >= 0.0f ? box.Max.y : box.Min.y,
+                plane.z >= 0.0f ? box.Max.z : box.Min.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
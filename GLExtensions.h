@@ -0,0 +1,118 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <string_view>
+
+// The glad loader is generated for core OpenGL 3.3 only. Enums and entry points of
+// extensions and later versions that are used when the driver advertises them are
+// declared here; LoadGLExtensions fills the entry points after gladLoadGLLoader.
+
+// EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// ARB_texture_compression_bptc, core in 4.2
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+// ARB_multi_draw_indirect, core in 4.3
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// ARB_get_program_binary, core in 4.1
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// KHR_parallel_shader_compile
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// entry points beyond the generated loader, null when the driver lacks them
+struct GLExtensionFunctions
+{
+    void (APIENTRYP MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride) = nullptr;
+    // only set when the driver also offers at least one binary format
+    void (APIENTRYP GetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary) = nullptr;
+    void (APIENTRYP ProgramBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) = nullptr;
+    void (APIENTRYP ProgramParameteri)(GLuint program, GLenum pname, GLint value) = nullptr;
+    void (APIENTRYP MaxShaderCompilerThreads)(GLuint count) = nullptr;
+    // GL_COMPLETION_STATUS_KHR can be queried without waiting for the compiler
+    bool ParallelShaderCompile = false;
+};
+
+inline GLExtensionFunctions glExtensions;
+
+// needs a current context
+inline bool HasGLVersion(int major, int minor)
+{
+    GLint currentMajor = 0, currentMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &currentMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &currentMinor);
+    return currentMajor > major || (currentMajor == major && currentMinor >= minor);
+}
+
+// needs a current context
+inline bool HasGLExtension(std::string_view name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && name == extension)
+            return true;
+    }
+    return false;
+}
+
+// needs a current context; loader is the same function handed to gladLoadGLLoader
+inline void LoadGLExtensions(GLADloadproc loader)
+{
+    glExtensions = GLExtensionFunctions();
+    // the indirect shaders are GLSL 4.30 and set their sampler units themselves, so the extension alone isn't enough
+    if (HasGLVersion(4, 3))
+    {
+        glExtensions.MultiDrawElementsIndirect = reinterpret_cast<decltype(glExtensions.MultiDrawElementsIndirect)>(
+            loader("glMultiDrawElementsIndirect"));
+    }
+    GLint binaryFormats = 0;
+    if (HasGLVersion(4, 1) || HasGLExtension("GL_ARB_get_program_binary"))
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    if (binaryFormats > 0)
+    {
+        glExtensions.GetProgramBinary = reinterpret_cast<decltype(glExtensions.GetProgramBinary)>(loader("glGetProgramBinary"));
+        glExtensions.ProgramBinary = reinterpret_cast<decltype(glExtensions.ProgramBinary)>(loader("glProgramBinary"));
+        glExtensions.ProgramParameteri = reinterpret_cast<decltype(glExtensions.ProgramParameteri)>(loader("glProgramParameteri"));
+    }
+    // the ARB version of the extension only differs in the suffix
+    if (HasGLExtension("GL_KHR_parallel_shader_compile"))
+    {
+        glExtensions.ParallelShaderCompile = true;
+        glExtensions.MaxShaderCompilerThreads = reinterpret_cast<decltype(glExtensions.MaxShaderCompilerThreads)>(
+            loader("glMaxShaderCompilerThreadsKHR"));
+    }
+    else if (HasGLExtension("GL_ARB_parallel_shader_compile"))
+    {
+        glExtensions.ParallelShaderCompile = true;
+        glExtensions.MaxShaderCompilerThreads = reinterpret_cast<decltype(glExtensions.MaxShaderCompilerThreads)>(
+            loader("glMaxShaderCompilerThreadsARB"));
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "RenderStats.h"
+
+#include <array>
+
+// Shadow copy of the bindings the draw code changes most: the program in use, the vertex
+// array, the active texture unit and the 2D texture of each unit. A call that would set what
+// is already set is dropped; issued and dropped calls are counted in renderStats, together
+// with the uniform values Shader filters the same way. The copy is only right as long as
+// these bindings are changed through it, so every bind in the tree goes through glState,
+// and objects that are deleted are reported with the Forget calls.
+class GLState
+{
+public:
+    // units tracked; binds to higher units are issued every time
+    static const unsigned int TEXTURE_UNITS = 16;
+
+    void UseProgram(unsigned int program)
+    {
+        if (changed(currentProgram, program))
+            glUseProgram(program);
+    }
+
+    unsigned int Program() const
+    {
+        return currentProgram;
+    }
+
+    void BindVertexArray(unsigned int VAO)
+    {
+        if (changed(currentVertexArray, VAO))
+            glBindVertexArray(VAO);
+    }
+
+    // binds a 2D texture to unit, switching the active unit only if the texture changes
+    void BindTexture(unsigned int unit, unsigned int texture)
+    {
+        if (unit < TEXTURE_UNITS && !changed(textures[unit], texture))
+            return;
+        if (activeUnit != unit)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+            renderStats.StateCalls++;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (unit >= TEXTURE_UNITS)
+            renderStats.StateCalls++;
+    }
+
+    // binds texture for glTexImage2D and friends, which act on the active unit: unlike
+    // BindTexture this selects the unit even when the texture is already bound there
+    void BindTextureForUpdate(unsigned int texture)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        activeUnit = 0;
+        renderStats.StateCalls++;
+        if (changed(textures[0], texture))
+            glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    // GL unbinds deleted objects, and their names can be handed out again
+    void ForgetTexture(unsigned int texture)
+    {
+        for (unsigned int& bound : textures)
+        {
+            if (bound == texture)
+                bound = 0;
+        }
+    }
+
+    void ForgetVertexArray(unsigned int VAO)
+    {
+        if (currentVertexArray == VAO)
+            currentVertexArray = 0;
+    }
+
+    // there is no ForgetProgram: a deleted program stays in use, and keeps its name, until
+    // another one replaces it, so the copy is already right
+
+private:
+    // initial GL state
+    unsigned int currentProgram = 0;
+    unsigned int currentVertexArray = 0;
+    unsigned int activeUnit = 0;
+    std::array<unsigned int, TEXTURE_UNITS> textures = {};
+
+    static bool changed(unsigned int& current, unsigned int value)
+    {
+        if (current == value)
+        {
+            renderStats.StateCallsFiltered++;
+            return false;
+        }
+        current = value;
+        renderStats.StateCalls++;
+        return true;
+    }
+};
+
+inline GLState glState;
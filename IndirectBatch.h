@@ -0,0 +1,156 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+#include "Mesh.h"
+#include "RenderStats.h"
+#include "GLState.h"
+
+#include <vector>
+
+// texture units of the indirect shaders' samplers, see BackpackIndirect.frag
+const unsigned int INDIRECT_DIFFUSE_UNIT = 0;
+const unsigned int INDIRECT_SPECULAR_UNIT = 1;
+
+// layout read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint Count;
+    GLuint InstanceCount;
+    GLuint FirstIndex;
+    GLint  BaseVertex;
+    GLuint BaseInstance;
+};
+
+// Commands for meshes that share a VAO (one Model), submitted with glMultiDrawElementsIndirect
+// instead of a draw per mesh. Draws are grouped by material: a group's textures are bound once
+// and the group costs one call. Every fragment of a call samples the same textures, so the
+// shader needs no per-draw texture index, which GLSL only allows to be dynamically uniform.
+// Needs GL 4.3, see LoadGLExtensions.
+class IndirectBatch
+{
+public:
+    IndirectBatch()
+    {
+        glGenBuffers(1, &commandBuffer);
+    }
+
+    ~IndirectBatch()
+    {
+        glDeleteBuffers(1, &commandBuffer);
+    }
+
+    IndirectBatch(const IndirectBatch&) = delete;
+    IndirectBatch& operator=(const IndirectBatch&) = delete;
+
+    static bool Supported()
+    {
+        return glExtensions.MultiDrawElementsIndirect != nullptr;
+    }
+
+    // groups stay, a model keeps drawing with the same materials
+    void Clear()
+    {
+        for (Group& group : groups)
+            group.Commands.clear();
+        triangles = 0;
+    }
+
+    // draws instanceCount instances of mesh at level of detail lod, reading instances
+    // baseInstance onwards of the instance buffer attached to the VAO; the instance runs of
+    // different calls must not overlap, and all meshes must share one index type
+    void Add(const Mesh& mesh, unsigned int instanceCount, unsigned int baseInstance, unsigned int lod = 0)
+    {
+        IndexRange level = { mesh.lods[lod].FirstIndex, mesh.lods[lod].IndexCount };
+        AddRanges(mesh, &level, 1, instanceCount, baseInstance);
+    }
+
+    // like Add, with a command per range of the mesh's indices (e.g. its visible clusters)
+    void AddRanges(const Mesh& mesh, const IndexRange* ranges, size_t rangeCount, unsigned int instanceCount, unsigned int baseInstance)
+    {
+        if (instanceCount == 0 || rangeCount == 0)
+            return;
+        indexType = mesh.indexType;
+        unsigned int diffuse = 0, specular = 0;
+        for (const Texture& texture : mesh.textures)
+        {
+            if (texture.type == "texture_diffuse" && !diffuse)
+                diffuse = texture.id;
+            else if (texture.type == "texture_specular" && !specular)
+                specular = texture.id;
+        }
+
+        // commands keep the order they're added in within their group
+        Group& group = groupFor(diffuse, specular);
+        for (size_t i = 0; i < rangeCount; ++i)
+        {
+            group.Commands.push_back({ ranges[i].IndexCount, instanceCount, mesh.firstIndex + ranges[i].FirstIndex,
+                static_cast<GLint>(mesh.baseVertex), baseInstance });
+            triangles += ranges[i].IndexCount / 3 * instanceCount;
+        }
+    }
+
+    // uploads the commands added since Clear, one group after the other
+    void Upload()
+    {
+        commands.clear();
+        for (Group& group : groups)
+        {
+            group.FirstCommand = static_cast<unsigned int>(commands.size());
+            commands.insert(commands.end(), group.Commands.begin(), group.Commands.end());
+        }
+        // respecifying the store orphans the one draws may still be reading
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+    }
+
+    // binds each group's textures to INDIRECT_DIFFUSE_UNIT and INDIRECT_SPECULAR_UNIT
+    void Draw(unsigned int VAO)
+    {
+        glState.BindVertexArray(VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        for (const Group& group : groups)
+        {
+            if (group.Commands.empty())
+                continue;
+            glState.BindTexture(INDIRECT_DIFFUSE_UNIT, group.Diffuse);
+            glState.BindTexture(INDIRECT_SPECULAR_UNIT, group.Specular);
+            glExtensions.MultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                (void*)(group.FirstCommand * sizeof(DrawElementsIndirectCommand)),
+                static_cast<GLsizei>(group.Commands.size()), 0);
+            renderStats.DrawCalls++;
+        }
+        renderStats.Triangles += triangles;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+private:
+    struct Group
+    {
+        unsigned int Diffuse;
+        unsigned int Specular;
+        std::vector<DrawElementsIndirectCommand> Commands;
+        // of the uploaded commands
+        unsigned int FirstCommand = 0;
+    };
+
+    unsigned int commandBuffer = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<Group> groups;
+    // drawn by all commands together
+    unsigned int triangles = 0;
+
+    // a model has a handful of materials, a linear search beats hashing
+    Group& groupFor(unsigned int diffuse, unsigned int specular)
+    {
+        for (Group& group : groups)
+        {
+            if (group.Diffuse == diffuse && group.Specular == specular)
+                return group;
+        }
+        groups.push_back({ diffuse, specular, {} });
+        return groups.back();
+    }
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+
+#include "Bounds.h"
+#include "Frustum.h"
+#include "RenderStats.h"
+#include "GLState.h"
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <vector>
+
+// Per-instance vertex attributes, advanced once per instance (glVertexAttribDivisor 1):
+// locations 3-6 hold the model matrix columns, 7-9 the world space normal matrix.
+const unsigned int INSTANCE_MODEL_LOCATION = 3;
+const unsigned int INSTANCE_NORMAL_LOCATION = 7;
+
+struct InstanceData
+{
+    glm::mat4 Model;
+    glm::mat3 Normal;
+};
+
+// Vertex buffer of InstanceData that can be attached to any VAO (the raw cube VAO or a
+// Model's shared one) and drawn with glDrawArraysInstanced/glDrawElementsInstanced.
+class InstanceBuffer
+{
+public:
+    unsigned int ID = 0;
+    unsigned int Count = 0;
+
+    InstanceBuffer()
+    {
+        glGenBuffers(1, &ID);
+    }
+
+    ~InstanceBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    // adds the per-instance attributes to a VAO, starting at instance firstInstance of the
+    // buffer (GL 3.3 has no base instance for draws); leaves the VAO bound
+    void Attach(unsigned int VAO, unsigned int firstInstance = 0) const
+    {
+        size_t base = static_cast<size_t>(firstInstance) * sizeof(InstanceData);
+        glState.BindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        for (unsigned int i = 0; i < 4; ++i)
+        {
+            unsigned int location = INSTANCE_MODEL_LOCATION + i;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(base + offsetof(InstanceData, Model) + i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location, 1);
+        }
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            unsigned int location = INSTANCE_NORMAL_LOCATION + i;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                (void*)(base + offsetof(InstanceData, Normal) + i * sizeof(glm::vec3)));
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    void Update(const InstanceData* instances, unsigned int count)
+    {
+        uploadedFrom = nullptr;
+        glBindBuffer(GL_ARRAY_BUFFER, ID);
+        // respecifying the whole store orphans the old one instead of waiting for draws still using it
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), instances, GL_DYNAMIC_DRAW);
+        Count = count;
+    }
+
+    void Update(const std::vector<InstanceData>& instances)
+    {
+        Update(instances.data(), static_cast<unsigned int>(instances.size()));
+    }
+
+    // fills the normal matrices from the model matrices, then uploads
+    void Update(const std::vector<glm::mat4>& models)
+    {
+        staging.resize(models.size());
+        for (size_t i = 0; i < models.size(); ++i)
+            staging[i] = MakeInstance(models[i]);
+        Update(staging);
+    }
+
+    // uploads only the instances whose transformed localBounds touch the frustum, counting
+    // them in renderStats, nearest first if order is enabled. A visible set identical to the
+    // previous call's on the same vector isn't uploaded again, so edit instances through
+    // Update rather than in place. Returns the distance of the nearest visible instance (0
+    // without order).
+    float UpdateVisible(const std::vector<InstanceData>& instances, const Bounds& localBounds, const Frustum& frustum,
+        const DrawOrder& order = DrawOrder())
+    {
+        visible.clear();
+        Cull(instances, localBounds, frustum, visible);
+        float nearest = 0.0f;
+        if (order.Enabled)
+            nearest = SortFrontToBack(instances, localBounds.Center(), order, visible, 0, visible.size(), depthQueue);
+        UpdateSelection(instances, visible);
+        return nearest;
+    }
+
+    // uploads instances[selection[0]], instances[selection[1]], ... in that order, unless
+    // the previous upload was the same selection of the same vector; true if it uploaded
+    bool UpdateSelection(const std::vector<InstanceData>& instances, const std::vector<unsigned int>& selection)
+    {
+        if (uploadedFrom == instances.data() && selection == uploadedSelection)
+            return false;
+        staging.resize(selection.size());
+        for (size_t i = 0; i < selection.size(); ++i)
+            staging[i] = instances[selection[i]];
+        Update(staging);
+        uploadedFrom = instances.data();
+        uploadedSelection = selection;
+        return true;
+    }
+
+    // appends the indices of the instances whose transformed localBounds touch the frustum
+    // to visible and counts them in renderStats
+    static void Cull(const std::vector<InstanceData>& instances, const Bounds& localBounds, const Frustum& frustum,
+        std::vector<unsigned int>& visible)
+    {
+        glm::vec3 localCenter = localBounds.Center();
+        float localRadius = localBounds.Radius();
+        size_t first = visible.size();
+        for (unsigned int i = 0; i < instances.size(); ++i)
+        {
+            const glm::mat4& model = instances[i].Model;
+            // sphere first, it's cheaper and rejects most; the box is tighter for long shapes
+            float scale = std::sqrt(std::max({ glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+                glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])) }));
+            glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+            if (frustum.IntersectsSphere(center, localRadius * scale) && frustum.IntersectsBox(localBounds.Transformed(model)))
+                visible.push_back(i);
+        }
+        unsigned int accepted = static_cast<unsigned int>(visible.size() - first);
+        renderStats.Submitted += accepted;
+        renderStats.Culled += static_cast<unsigned int>(instances.size()) - accepted;
+    }
+
+    // reorders selection[first, first + count) by the distance of each instance's localCenter
+    // from the view, nearest first, so instanced draws fill the depth buffer front to back;
+    // returns the nearest distance
+    static float SortFrontToBack(const std::vector<InstanceData>& instances, const glm::vec3& localCenter,
+        const DrawOrder& order, std::vector<unsigned int>& selection, size_t first, size_t count, RenderQueue& queue)
+    {
+        if (count == 0)
+            return 0.0f;
+        queue.Clear();
+        for (size_t i = first; i < first + count; ++i)
+        {
+            glm::vec3 center = glm::vec3(instances[selection[i]].Model * glm::vec4(localCenter, 1.0f));
+            float depth = glm::length(center - order.ViewPosition);
+            queue.Submit(RenderQueue::Key(RENDER_PASS_OPAQUE, 0, 0, depth), selection[i]);
+        }
+        queue.Sort();
+        for (size_t i = 0; i < count; ++i)
+            selection[first + i] = queue.Item(i);
+        return glm::length(glm::vec3(instances[selection[first]].Model * glm::vec4(localCenter, 1.0f)) - order.ViewPosition);
+    }
+
+    static InstanceData MakeInstance(const glm::mat4& model)
+    {
+        InstanceData instance;
+        instance.Model = model;
+        instance.Normal = glm::transpose(glm::inverse(glm::mat3(model)));
+        return instance;
+    }
+
+private:
+    std::vector<InstanceData> staging;
+    std::vector<unsigned int> visible;
+    RenderQueue depthQueue;
+    // what the last UpdateSelection call uploaded
+    const InstanceData* uploadedFrom = nullptr;
+    std::vector<unsigned int> uploadedSelection;
+};
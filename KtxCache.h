@@ -0,0 +1,185 @@
+#pragma once
+
+// Compressed texture cache: the first time a texture is loaded its mip chain is encoded
+// (see TextureCompressor.h) and written next to the source image as "<source>.ktx", a
+// KTX 1.1 file. Later loads read the levels back and upload them as they are.
+// The key/value data holds a stamp of the source file (size, mtime, flip, cache
+// version); a cache with a different stamp or a format the driver can't sample is
+// ignored and rebuilt.
+
+#include "TextureCompressor.h"
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bump whenever the encoders change, older caches are then rebuilt
+const unsigned int KTX_CACHE_VERSION = 1;
+
+class KtxCache
+{
+public:
+    static std::string PathFor(const std::string& sourcePath)
+    {
+        return sourcePath + ".ktx";
+    }
+
+    // empty if the source can't be stat'ed
+    static std::string SourceStamp(const std::string& sourcePath, bool flipVertically)
+    {
+        std::error_code error;
+        uint64_t size = std::filesystem::file_size(sourcePath, error);
+        if (error)
+            return std::string();
+        auto time = std::filesystem::last_write_time(sourcePath, error).time_since_epoch().count();
+        if (error)
+            return std::string();
+        return std::to_string(size) + " " + std::to_string(time) + " " + (flipVertically ? "flip" : "noflip")
+            + " v" + std::to_string(KTX_CACHE_VERSION);
+    }
+
+    static bool Load(const std::string& sourcePath, const std::string& stamp, unsigned int support, CompressedImage& image)
+    {
+        std::ifstream file(PathFor(sourcePath), std::ios::binary);
+        if (!file)
+            return false;
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        if (data.size() < sizeof(KtxHeader))
+            return false;
+        KtxHeader header;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.Identifier, identifier, sizeof(identifier)) != 0 || header.Endianness != 0x04030201
+            || header.GlType != 0 || header.NumberOfFaces != 1 || header.NumberOfMipmapLevels == 0
+            || !TextureCompressor::IsSupported(header.GlInternalFormat, support))
+            return false;
+
+        size_t offset = sizeof(KtxHeader);
+        size_t keyValueEnd = offset + header.BytesOfKeyValueData;
+        if (keyValueEnd > data.size() || findValue(data, offset, keyValueEnd, stampKey) != stamp)
+            return false;
+        offset = keyValueEnd;
+
+        image.InternalFormat = header.GlInternalFormat;
+        image.Levels.clear();
+        image.Data.clear();
+        int width = static_cast<int>(header.PixelWidth);
+        int height = static_cast<int>(header.PixelHeight);
+        for (uint32_t level = 0; level < header.NumberOfMipmapLevels; ++level)
+        {
+            uint32_t imageSize;
+            if (offset + sizeof(imageSize) > data.size())
+                return false;
+            std::memcpy(&imageSize, data.data() + offset, sizeof(imageSize));
+            offset += sizeof(imageSize);
+            if (imageSize != TextureCompressor::LevelSize(image.InternalFormat, width, height) || offset + imageSize > data.size())
+                return false;
+            CompressedLevel info = { width, height, image.Data.size(), imageSize };
+            image.Data.insert(image.Data.end(), data.begin() + offset, data.begin() + offset + imageSize);
+            image.Levels.push_back(info);
+            offset += pad4(imageSize);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return true;
+    }
+
+    static bool Save(const std::string& sourcePath, const std::string& stamp, const CompressedImage& image)
+    {
+        if (image.Levels.empty())
+            return false;
+        std::string keyValue = std::string(stampKey) + '\0' + stamp + '\0';
+        uint32_t keyValueSize = static_cast<uint32_t>(keyValue.size());
+
+        KtxHeader header = {};
+        std::memcpy(header.Identifier, identifier, sizeof(identifier));
+        header.Endianness = 0x04030201;
+        header.GlTypeSize = 1;
+        header.GlInternalFormat = image.InternalFormat;
+        header.GlBaseInternalFormat = image.InternalFormat == GL_COMPRESSED_RED_RGTC1 ? GL_RED
+            : image.InternalFormat == GL_COMPRESSED_RG_RGTC2 ? GL_RG
+            : image.InternalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+        header.PixelWidth = image.Levels[0].Width;
+        header.PixelHeight = image.Levels[0].Height;
+        header.NumberOfFaces = 1;
+        header.NumberOfMipmapLevels = static_cast<uint32_t>(image.Levels.size());
+        header.BytesOfKeyValueData = static_cast<uint32_t>(sizeof(keyValueSize) + pad4(keyValue.size()));
+
+        // written under a temporary name so concurrent or interrupted writes never leave a truncated cache
+        std::string cachePath = PathFor(sourcePath);
+        std::string tempPath = cachePath + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            static const char zeros[4] = {};
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(&keyValueSize), sizeof(keyValueSize));
+            out.write(keyValue.data(), keyValue.size());
+            out.write(zeros, pad4(keyValue.size()) - keyValue.size());
+            for (const CompressedLevel& level : image.Levels)
+            {
+                uint32_t imageSize = static_cast<uint32_t>(level.Size);
+                out.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+                out.write(reinterpret_cast<const char*>(image.Data.data() + level.Offset), level.Size);
+                out.write(zeros, pad4(level.Size) - level.Size);
+            }
+            if (!out)
+                return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        return !error;
+    }
+
+private:
+    struct KtxHeader
+    {
+        unsigned char Identifier[12];
+        uint32_t Endianness;
+        uint32_t GlType;
+        uint32_t GlTypeSize;
+        uint32_t GlFormat;
+        uint32_t GlInternalFormat;
+        uint32_t GlBaseInternalFormat;
+        uint32_t PixelWidth;
+        uint32_t PixelHeight;
+        uint32_t PixelDepth;
+        uint32_t NumberOfArrayElements;
+        uint32_t NumberOfFaces;
+        uint32_t NumberOfMipmapLevels;
+        uint32_t BytesOfKeyValueData;
+    };
+
+    static constexpr unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+    static constexpr const char* stampKey = "LearnOpenGL.source";
+
+    static size_t pad4(size_t size)
+    {
+        return (size + 3) & ~size_t(3);
+    }
+
+    // value of a null terminated key in the key/value section, empty if it's missing
+    static std::string findValue(const std::vector<unsigned char>& data, size_t offset, size_t end, const char* key)
+    {
+        while (offset + sizeof(uint32_t) <= end)
+        {
+            uint32_t size;
+            std::memcpy(&size, data.data() + offset, sizeof(size));
+            offset += sizeof(size);
+            if (offset + size > end)
+                break;
+            const char* pair = reinterpret_cast<const char*>(data.data() + offset);
+            size_t keyLength = strnlen(pair, size);
+            if (keyLength < size && std::strcmp(pair, key) == 0)
+                return std::string(pair + keyLength + 1, strnlen(pair + keyLength + 1, size - keyLength - 1));
+            offset += pad4(size);
+        }
+        return std::string();
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Camera.h"
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Picks a mesh's level of detail per instance from its projected error: the coarsest level
+// whose deviation (MeshLod::Error) covers at most Threshold pixels at the instance's distance
+// from the camera. A default constructed selector is disabled and always picks the full mesh.
+struct LodSelector
+{
+    bool Enabled = false;
+    glm::vec3 CameraPosition = glm::vec3(0.0f);
+    // pixels covered by one world unit at distance 1
+    float PixelsPerUnit = 0.0f;
+    float Threshold = 1.0f;
+
+    // for a perspective projection with the camera's vertical field of view
+    static LodSelector FromCamera(const Camera& camera, float viewportHeight, float threshold = 1.0f)
+    {
+        LodSelector selector;
+        selector.Enabled = true;
+        selector.CameraPosition = camera.Position;
+        selector.PixelsPerUnit = viewportHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+        selector.Threshold = threshold;
+        return selector;
+    }
+
+    unsigned int Select(const Mesh& mesh, const glm::mat4& model) const
+    {
+        if (!Enabled || mesh.lods.size() < 2)
+            return 0;
+        float scale = std::sqrt(std::max({ glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+            glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])) }));
+        glm::vec3 center = glm::vec3(model * glm::vec4(mesh.bounds.Center(), 1.0f));
+        // distance to the nearest point of the bounding sphere, so the side facing the camera decides
+        float distance = std::max(glm::length(center - CameraPosition) - mesh.bounds.Radius() * scale, 1e-4f);
+        float pixelsPerMeshUnit = scale * PixelsPerUnit / distance;
+
+        unsigned int lod = 0;
+        while (lod + 1 < mesh.lods.size() && mesh.lods[lod + 1].Error * pixelsPerMeshUnit <= Threshold)
+            ++lod;
+        return lod;
+    }
+};
@@ -1,8 +1,19 @@
 #include <iostream>
 #include <filesystem>
 //TODO fog implementation with depth buffer
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
 #include <glad/glad.h>
+#ifdef LEARNOPENGL_HEADLESS
+#include "OffscreenContext.h"
+#else
 #include <GLFW/glfw3.h>
+#endif
 #include "stb_image.h"
 
 #include <glm.hpp>
@@ -11,16 +22,37 @@
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
 #include "Camera.h"
 #include "Model.h"
+#include "Benchmark.h"
+#include "RenderStats.h"
+#include "UniformBuffer.h"
+#include "InstanceBuffer.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include "Frustum.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+#include "ProgramCache.h"
+#include "IndirectBatch.h"
+#include "LodSelector.h"
+#include "ClusterCuller.h"
+#include "RenderQueue.h"
 
 #include <assimp/Importer.hpp>
 
+#ifndef LEARNOPENGL_HEADLESS
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
+#endif
 unsigned int loadTexture(const char* path);
+float getTime();
+int lightingVariantKey(bool dirLight, bool spotLight, bool emission, int pointLights);
+int lightingVariantKey(const LightsBlock& lights, bool emission);
+std::vector<std::string> lightingDefines(int variantKey);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
@@ -34,10 +66,33 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 glm::vec3 lightPos(1.2f, 2.0f, 0.0f);
+bool flashlight = true;
+bool depthPrepass = false;
 float range;
 
-int main()
+const auto startTime = std::chrono::steady_clock::now();
+
+int main(int argc, char** argv)
 {
+    BenchmarkOptions options = BenchmarkOptions::Parse(argc, argv);
+
+#ifdef LEARNOPENGL_HEADLESS
+    OffscreenContext context;
+    if (!context.Create(SCR_WIDTH, SCR_HEIGHT))
+    {
+        std::cout << "Failed to create offscreen context" << std::endl;
+        return -1;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)OffscreenContext::GetProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+    LoadGLExtensions((GLADloadproc)OffscreenContext::GetProcAddress);
+    context.CreateFramebuffer();
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+#else
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -51,20 +106,29 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (options.Enabled)
+        glfwSwapInterval(0);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    LoadGLExtensions((GLADloadproc)glfwGetProcAddress);
     glViewport(0, 0, 800, 600);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+#endif
 
     glEnable(GL_DEPTH_TEST);
     stbi_set_flip_vertically_on_load(true);
+    ProgramCache::Enabled = options.ProgramBinaryCache;
+    // every program is submitted here and in the scene setup below, and checked on first use
+    Shader::AsyncCompile = options.AsyncShaders;
+    if (options.AsyncShaders && glExtensions.MaxShaderCompilerThreads)
+        glExtensions.MaxShaderCompilerThreads(0xFFFFFFFF);
 
 
     auto projPath = std::filesystem::current_path();
@@ -72,8 +136,18 @@ int main()
     std::filesystem::path fragmentShaderPath = projPath / "FragmentShader.frag";
     std::filesystem::path lightFragmentShaderPath = projPath / "lightSource.frag";
     std::filesystem::path lightVertexShaderPath = projPath / "lightSource.vert";
-    Shader LightingShader(vertexShaderPath.string().c_str(), fragmentShaderPath.string().c_str());
+    // the cube shader is compiled per light and material configuration, see FragmentShader.frag
+    ShaderVariants lightingVariants(vertexShaderPath.string(), fragmentShaderPath.string());
     Shader lightSourceShader(lightVertexShaderPath.string().c_str(), lightFragmentShaderPath.string().c_str());
+    // the cube vertex shader without any shading, for the depth pre-pass
+    std::filesystem::path depthOnlyFragmentShaderPath = projPath / "DepthOnly.frag";
+    Shader depthOnlyShader(vertexShaderPath.string().c_str(), depthOnlyFragmentShaderPath.string().c_str());
+    depthPrepass = options.DepthPrepass;
+    flashlight = options.Flashlight;
+    // the cube scenes start with the lights the options ask for
+    int initialLightingKey = lightingVariantKey(true, flashlight, true, options.PointLights);
+    if (options.Scene != SCENE_BACKPACK)
+        lightingVariants.Prepare(lightingDefines(initialLightingKey));
     
 
     float vertices[] = {
@@ -148,7 +222,7 @@ int main()
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     
-    glBindVertexArray(VAO);
+    glState.BindVertexArray(VAO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
@@ -156,9 +230,18 @@ int main()
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
 
-    unsigned int lightSourceVAO;
+    // the moving red light and the three colored lights are separate instanced draws, each
+    // with its own VAO, because GL 3.3 can't start an instanced draw at a base instance
+    unsigned int lightSourceVAO, redLightVAO;
     glGenVertexArrays(1, &lightSourceVAO);
-    glBindVertexArray(lightSourceVAO);
+    glState.BindVertexArray(lightSourceVAO);
+
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenVertexArrays(1, &redLightVAO);
+    glState.BindVertexArray(redLightVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
@@ -167,215 +250,496 @@ int main()
     std::filesystem::path containerPath = projPath / "Resources/container2.png";
     std::filesystem::path containerSpecularPath = projPath / "Resources/container2_specular.png";
     std::filesystem::path matrixPath = projPath / "Resources/matrix.jpg";
+    TextureLoader::Shared().Compress = options.CompressTextures;
     unsigned int diffuseMap = loadTexture(containerPath.string().c_str());
     unsigned int specularMap = loadTexture(containerSpecularPath.string().c_str());
     unsigned int emissionMap = loadTexture(matrixPath.string().c_str());
 
-    LightingShader.use();
-    LightingShader.setInt("material.diffuse", 0);
-    LightingShader.setInt("material.specular", 1);
-    LightingShader.setInt("material.emission", 2);
+    lightingVariants.OnCompile = [](Shader& shader)
+    {
+        shader.setInt("material.diffuse", 0);
+        shader.setInt("material.specular", 1);
+        shader.setInt("material.emission", 2);
+
+        shader.setFloat("material.shininess", 32.0f);
+    };
+
+    // camera matrices and lights are shared by every program through two uniform blocks,
+    // each refreshed with a single upload per frame
+    UniformBuffer frameUniforms(sizeof(FrameBlock), FRAME_BLOCK_BINDING);
+    UniformBuffer lightUniforms(sizeof(LightsBlock), LIGHTS_BLOCK_BINDING);
+    FrameBlock frameData;
+    LightsBlock lightsData = {};
 
     glm::vec3 ligthDirection = glm::vec3(0.0f, -1.0f, 0.0f);
     
     range = 0.5;    
 
+    // model matrices of the lit cubes: the 10 containers, or a synthetic grid for the instances scene
+    std::vector<glm::mat4> cubeModels;
+    glm::vec3 sceneCenter(0.0f, 0.0f, -6.0f);
+    float sceneRadius = 12.0f;
+    float farPlane = 100.0f;
+    if (options.Scene == SCENE_INSTANCES)
+    {
+        unsigned int instanceCount = options.InstanceCount();
+        unsigned int side = static_cast<unsigned int>(std::ceil(std::cbrt(static_cast<double>(instanceCount))));
+        const float spacing = 1.5f;
+        float extent = side * spacing;
+        cubeModels.reserve(instanceCount);
+        for (unsigned int i = 0; i < instanceCount; i++)
+        {
+            glm::vec3 cell(static_cast<float>(i % side), static_cast<float>((i / side) % side), static_cast<float>(i / (side * side)));
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), cell * spacing - glm::vec3(extent * 0.5f));
+            model = glm::rotate(model, glm::radians(20.0f * (i % 18)), glm::vec3(1.0f, 0.3f, 0.5f));
+            cubeModels.push_back(model);
+        }
+        sceneCenter = glm::vec3(0.0f);
+        sceneRadius = extent * 0.75f;
+        farPlane = std::max(farPlane, extent * 2.0f);
+    }
+    else if (options.Scene == SCENE_CUBES)
+    {
+        for (unsigned int i = 0; i < 10; i++)
+        {
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, cubePositions[i]);
+            float angle = 20.0f * i;
+            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+            cubeModels.push_back(model);
+        }
+    }
+
+    // every cube is drawn by one instanced call over the instances that survive frustum culling
+    const Bounds cubeBounds = { glm::vec3(-0.5f), glm::vec3(0.5f) };
+    std::vector<InstanceData> cubeInstanceData;
+    cubeInstanceData.reserve(cubeModels.size());
+    for (const glm::mat4& model : cubeModels)
+        cubeInstanceData.push_back(InstanceBuffer::MakeInstance(model));
+    InstanceBuffer cubeInstances;
+    cubeInstances.Attach(VAO);
+
+    std::vector<InstanceData> pointLightInstanceData;
+    for (unsigned int i = 1; i < 4; i++)
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, pointLightPositions[i]);
+        model = glm::scale(model, glm::vec3(0.2f));
+        pointLightInstanceData.push_back(InstanceBuffer::MakeInstance(model));
+    }
+    InstanceBuffer pointLightInstances;
+    pointLightInstances.Attach(lightSourceVAO);
+
+    InstanceBuffer redLightInstance;
+    redLightInstance.Attach(redLightVAO);
 
-    //std::filesystem::path backpackVertexShaderPath = projPath / "BackpackShader.vert";
-    //std::filesystem::path backpackFragmentShaderPath = projPath / "BackpackShader.frag";
-    //Shader backpackShader(backpackVertexShaderPath.string().c_str(), backpackFragmentShaderPath.string().c_str());
-    //char modelPath[] = "backpack/backpack.obj";
-    //Model backpackModel(modelPath);
+    // the draws of the cube scenes, items of sceneQueue
+    enum SceneDraw : uint32_t { DRAW_CUBES, DRAW_RED_LIGHT, DRAW_POINT_LIGHTS };
+    RenderQueue sceneQueue;
 
-    
+    std::unique_ptr<Shader> backpackShader;
+    std::unique_ptr<Model> backpackModel;
+    std::vector<InstanceData> backpackInstanceData;
+    if (options.Scene == SCENE_BACKPACK)
+    {
+        // the indirect shaders need GL 4.3, older contexts keep a draw per mesh
+        if (options.IndirectDraw && !IndirectBatch::Supported())
+        {
+            std::cout << "Multi-draw indirect needs OpenGL 4.3, drawing meshes one by one" << std::endl;
+            options.IndirectDraw = false;
+        }
+        std::filesystem::path backpackVertexShaderPath = projPath / (options.IndirectDraw ? "BackpackIndirect.vert" : "BackpackShader.vert");
+        std::filesystem::path backpackFragmentShaderPath = projPath / (options.IndirectDraw ? "BackpackIndirect.frag" : "BackpackShader.frag");
+        backpackShader = std::make_unique<Shader>(backpackVertexShaderPath.string().c_str(), backpackFragmentShaderPath.string().c_str());
+        char modelPath[] = "backpack/backpack.obj";
+        backpackModel = std::make_unique<Model>(modelPath, options.PackedVertices ? VERTEX_FORMAT_PACKED : VERTEX_FORMAT_FLOAT,
+            options.KeepGeometry);
+
+        // --instances N lays N backpacks out on a square grid, all drawn with one call per mesh
+        unsigned int instanceCount = options.InstanceCount();
+        unsigned int side = static_cast<unsigned int>(std::ceil(std::sqrt(static_cast<double>(instanceCount))));
+        const float spacing = 4.0f;
+        float extent = (side - 1) * spacing;
+        backpackInstanceData.reserve(instanceCount);
+        for (unsigned int i = 0; i < instanceCount; i++)
+        {
+            glm::vec3 cell(static_cast<float>(i % side), 0.0f, static_cast<float>(i / side));
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), cell * spacing - glm::vec3(extent * 0.5f, 0.0f, extent * 0.5f));
+            backpackInstanceData.push_back(InstanceBuffer::MakeInstance(model));
+        }
+        sceneCenter = glm::vec3(0.0f);
+        sceneRadius = std::max(6.0f, extent * 0.75f);
+        farPlane = std::max(farPlane, extent * 2.0f);
+    }
 
-    while (!glfwWindowShouldClose(window))
+    CameraPath cameraPath;
+    CameraPath recordedPath;
+    BenchmarkRecorder recorder;
+    unsigned int totalFrames = options.Frames;
+    if (options.Enabled)
     {
-        float currentFrame = static_cast<float>(glfwGetTime());
+        if (options.CameraPath.empty() || !cameraPath.Load(options.CameraPath))
+        {
+            cameraPath.GenerateOrbit(sceneRadius, sceneRadius * 0.25f, 20.0f);
+            for (CameraKeyframe& key : cameraPath.Keyframes)
+                key.Position += sceneCenter;
+        }
+        totalFrames = options.WarmupFrames + options.Frames;
+        // every run measures the same fully loaded scene
+        TextureLoader::Shared().Finish();
+        if (backpackShader)
+            backpackShader->use();
+        recorder.Begin(options.Frames);
+    }
+
+    // a live run starts drawing while programs still compile: the frame loop polls them and
+    // leaves out what they draw until they are ready. A benchmark run waits for them here
+    int lightSourceColorLocation = -1;
+    Shader* lightingShader = nullptr;
+    int lightingKey = -1;
+    if (options.Enabled)
+    {
+        lightSourceColorLocation = lightSourceShader.getUniformLocation("color");
+        if (options.Scene != SCENE_BACKPACK)
+        {
+            lightingShader = &lightingVariants.Get(lightingDefines(initialLightingKey));
+            lightingKey = initialLightingKey;
+            if (depthPrepass)
+                depthOnlyShader.use();
+        }
+    }
+
+    float loadTime = getTime();
+    if (!options.Enabled)
+        std::cout << "Load time: " << loadTime * 1000.0f << " ms" << std::endl;
+    // benchmark runs use a simulated clock starting at zero, live runs the wall clock
+    lastFrame = options.Enabled ? 0.0f : loadTime;
+
+    for (unsigned int frame = 0; ; ++frame)
+    {
+#ifdef LEARNOPENGL_HEADLESS
+        if (frame >= totalFrames)
+            break;
+#else
+        if (glfwWindowShouldClose(window) || (options.Enabled && frame >= totalFrames))
+            break;
+#endif
+        float currentFrame = options.Enabled ? options.Timestep * frame : getTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
+        bool measured = options.Enabled && frame >= options.WarmupFrames;
+        if (measured)
+            recorder.BeginFrame();
+        renderStats.Reset();
+        TextureLoader::Shared().Update();
+
+        if (options.Enabled)
+            cameraPath.Apply(currentFrame, camera);
+#ifndef LEARNOPENGL_HEADLESS
+        else
+            processInput(window);
+        if (!options.RecordPath.empty())
+            recordedPath.Record(currentFrame, camera);
+#endif
 
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glDepthFunc(GL_LESS);
 
-        /*backpackShader.use();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-        backpackShader.setMat4("view", view);
-        backpackShader.setMat4("projection", projection);
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-        backpackShader.setMat4("view", view);
-        backpackShader.setMat4("model", model);
-        backpackModel.Draw(backpackShader);*/
-
-        LightingShader.use();
-        
-        LightingShader.setFloat("pointLights[0].constant", 1.0f);
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, farPlane);
         glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 model = glm::mat4(1.0f);
-        //model = glm::rotate(model, glm::radians((float)glfwGetTime()) * 5.0f, glm::vec3(1.0f, 1.0f, 0.0f));
-        LightingShader.setMat4("model", model);
-        LightingShader.setMat4("view", view);
-        LightingShader.setMat4("projection", projection);
-
-
-        glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(deltaTime * 5.0f) * 3.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-        lightPos = glm::vec3(rotation * glm::vec4(lightPos, 1.0f));       
-        glm::vec3 lightPosView = glm::vec3(view * glm::vec4(lightPos, 1.0f));
-        //LightingShader.setVec3("light.position", lightPosView);
-        // 
-        float time = static_cast<float>(glfwGetTime());
-        ligthDirection.x = (sinf(time * 0.5f));
-        ligthDirection.y = (cosf(time * 0.5f));
-
-        glm::vec3 lightColor;
-        lightColor.x = (sinf(time * 2.0f) + 1.0f) * 0.5f;
-        lightColor.y = (sinf(time * 0.7f) + 1.0f) * 0.5f;
-        lightColor.z = (sinf(time * 1.3f) + 1.0f) * 0.5f;
-        glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
-        //Directional light
-        LightingShader.setVec3("dirLight.direction", glm::mat3(view) * ligthDirection);
-        LightingShader.setVec3("dirLight.diffuse", glm::vec3(0.0f,0.0f,0.5f));
-        LightingShader.setVec3("dirLight.specular", glm::vec3(0.9f, 0.8f, 1.0f));
-        LightingShader.setVec3("dirLight.ambient", 0.2f, 0.2f, 0.2f);
-        //Point lights
-        float constant = 1.0f;
-        float linear = 0.07f;
-        float quadratic = 0.017f;
-
-        LightingShader.setVec3("spotLight.position", glm::vec3(view * glm::vec4(camera.Position, 1.0f)));
-        LightingShader.setVec3("spotLight.direction", glm::mat3(view) * camera.Front);
-        LightingShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(12.5f)));
-        LightingShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(17.5f)));
-        LightingShader.setVec3("spotLight.ambient", 0.05f, 0.05f, 0.05f);
-        LightingShader.setVec3("spotLight.diffuse", glm::vec3(0.6f, 0.6f, 0.3f));
-        LightingShader.setVec3("spotLight.specular", glm::vec3(0.7f, 0.7f, 0.0f));
-        LightingShader.setFloat("spotLight.constant", constant);
-        LightingShader.setFloat("spotLight.linear", linear);
-        LightingShader.setFloat("spotLight.quadratic", quadratic);
-
-        glm::vec3 light1Pos = glm::vec3(pointLightPositions[0].x, pointLightPositions[0].y + ligthDirection.y, pointLightPositions[0].z + ligthDirection.x * 3 - 3);
-        LightingShader.setVec3("pointLights[0].position", glm::vec3(view* glm::vec4(light1Pos, 1.0f)));
-        LightingShader.setVec3("pointLights[0].ambient", 0.05f, 0.05f, 0.05f);
-        LightingShader.setVec3("pointLights[0].diffuse", glm::vec3(1.0f, 0.0f, 0.0f));
-        LightingShader.setVec3("pointLights[0].specular", glm::vec3(1.0f, 0.0f, 0.0f));
-        LightingShader.setFloat("pointLights[0].constant", constant);
-        LightingShader.setFloat("pointLights[0].linear", linear);
-        LightingShader.setFloat("pointLights[0].quadratic", quadratic);
-
-        LightingShader.setVec3("pointLights[1].position", glm::vec3(view* glm::vec4(pointLightPositions[1], 1.0f)));
-        LightingShader.setVec3("pointLights[1].ambient", 0.05f, 0.05f, 0.05f);
-        LightingShader.setVec3("pointLights[1].diffuse", diffuseColor);
-        LightingShader.setVec3("pointLights[1].specular", lightColor);
-        LightingShader.setFloat("pointLights[1].constant", constant);
-        LightingShader.setFloat("pointLights[1].linear", linear);
-        LightingShader.setFloat("pointLights[1].quadratic", quadratic);
-
-        LightingShader.setVec3("pointLights[2].position", glm::vec3(view * glm::vec4(pointLightPositions[2], 1.0f)));
-        LightingShader.setVec3("pointLights12].ambient", 0.05f, 0.05f, 0.05f);
-        LightingShader.setVec3("pointLights[2].diffuse", diffuseColor);
-        LightingShader.setVec3("pointLights[2].specular", lightColor);
-        LightingShader.setFloat("pointLights[2].constant", constant);
-        LightingShader.setFloat("pointLights[2].linear", linear);
-        LightingShader.setFloat("pointLights[2].quadratic", quadratic);
-
-        LightingShader.setVec3("pointLights[3].position", glm::vec3(view * glm::vec4(pointLightPositions[3], 1.0f)));
-        LightingShader.setVec3("pointLights[3].ambient", 0.05f, 0.05f, 0.05f);
-        LightingShader.setVec3("pointLights[3].diffuse", diffuseColor);
-        LightingShader.setVec3("pointLights[3].specular", lightColor);
-        LightingShader.setFloat("pointLights[3].constant", constant);
-        LightingShader.setFloat("pointLights[3].linear", linear);
-        LightingShader.setFloat("pointLights[3].quadratic", quadratic);
-
-        LightingShader.setVec3("light.position", glm::vec3(view * glm::vec4(camera.Position,1.0f)));
-        
-        LightingShader.setVec3("light.direction", glm::mat3(view) * camera.Front);
-        LightingShader.setFloat("light.cutOff", glm::cos(glm::radians(12.5f)));
-        LightingShader.setFloat("light.outerCutOff", glm::cos(glm::radians(17.5f)));
-
-        glm::vec3 ligthDir = glm::normalize(glm::mat3(view) * ligthDirection);
-        //LightingShader.setVec3("light.direction", ligthDir);
-
-        LightingShader.setVec3("material.specular", 0.7f, 0.7f, 0.7f);
-        LightingShader.setFloat("material.shininess", 32.0f);
-        
-        
-
-        //glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
-        //glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
-       /* LightingShader.setVec3("light.diffuse", glm::vec3(1.0f, 0.0f, 0.0f));
-        LightingShader.setVec3("light.specular", glm::vec3(1.0f, 0.0f, 0.0f));
-        LightingShader.setVec3("light.ambient", 0.2f, 0.2f, 0.2f);*/
-        
-  /*      LightingShader.setFloat("light.constant", 1.0f);
-        LightingShader.setFloat("light.linear", 0.07f);
-        LightingShader.setFloat("light.quadratic", 0.017f);*/
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, diffuseMap);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, specularMap);
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, emissionMap);
-
-        glBindVertexArray(VAO);
-        //glDrawArrays(GL_TRIANGLES, 0, 36);
-        for (unsigned int i = 0; i < 10; i++)
+        frameData.view = view;
+        frameData.projection = projection;
+        frameData.viewPos = glm::vec4(camera.Position, 1.0f);
+        frameUniforms.Update(frameData);
+        // --no-culling swaps in a frustum that contains everything
+        Frustum frustum = options.FrustumCulling ? Frustum(projection * view) : Frustum();
+        // --no-draw-sort keeps submission order
+        DrawOrder drawOrder = options.DrawSort ? DrawOrder::FromCamera(camera) : DrawOrder();
+
+        if (options.Scene == SCENE_BACKPACK)
         {
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-            LightingShader.setMat4("model", model);
-            glm::mat4 normalMatrix = glm::transpose(glm::inverse(view * model));
-            LightingShader.setMat4("normalMatrix", normalMatrix);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            // nothing to draw until the program is linked
+            if (backpackShader->IsReady())
+            {
+                backpackShader->use();
+                // --no-lod keeps every instance at the full mesh
+                LodSelector lods = options.LevelOfDetail ? LodSelector::FromCamera(camera, (float)SCR_HEIGHT) : LodSelector();
+                // rejecting back-facing clusters is only invisible if the rasterizer drops back faces too
+                ClusterCuller clusters = options.ClusterCulling ? ClusterCuller::FromCamera(camera, frustum, true) : ClusterCuller();
+                if (options.ClusterCulling)
+                    glEnable(GL_CULL_FACE);
+                if (options.IndirectDraw)
+                    backpackModel->DrawIndirect(*backpackShader, backpackInstanceData, frustum, lods, clusters, drawOrder);
+                else
+                    backpackModel->DrawInstanced(*backpackShader, backpackInstanceData, frustum, lods, clusters, drawOrder);
+                glDisable(GL_CULL_FACE);
+            }
         }
+        else
+        {
+            glm::mat4 model = glm::mat4(1.0f);
+            //model = glm::rotate(model, glm::radians((float)glfwGetTime()) * 5.0f, glm::vec3(1.0f, 1.0f, 0.0f));
+
+            glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(deltaTime * 5.0f) * 3.0f, glm::vec3(0.0f, 0.0f, 1.0f));
+            lightPos = glm::vec3(rotation * glm::vec4(lightPos, 1.0f));       
+            glm::vec3 lightPosView = glm::vec3(view * glm::vec4(lightPos, 1.0f));
+            //LightingShader.setVec3("light.position", lightPosView);
+            // 
+            float time = currentFrame;
+            ligthDirection.x = (sinf(time * 0.5f));
+            ligthDirection.y = (cosf(time * 0.5f));
+
+            glm::vec3 lightColor;
+            lightColor.x = (sinf(time * 2.0f) + 1.0f) * 0.5f;
+            lightColor.y = (sinf(time * 0.7f) + 1.0f) * 0.5f;
+            lightColor.z = (sinf(time * 1.3f) + 1.0f) * 0.5f;
+            glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
+            //Directional light
+            lightsData.dirLight.direction = glm::mat3(view) * ligthDirection;
+            lightsData.dirLight.diffuse = glm::vec3(0.0f, 0.0f, 0.5f);
+            lightsData.dirLight.specular = glm::vec3(0.9f, 0.8f, 1.0f);
+            lightsData.dirLight.ambient = glm::vec3(0.2f, 0.2f, 0.2f);
+            //Point lights
+            float constant = 1.0f;
+            float linear = 0.07f;
+            float quadratic = 0.017f;
+
+            SpotLightData& spotLight = lightsData.spotLight;
+            spotLight = SpotLightData();
+            if (flashlight)
+            {
+                spotLight.position = glm::vec3(view * glm::vec4(camera.Position, 1.0f));
+                spotLight.direction = glm::mat3(view) * camera.Front;
+                spotLight.cutOff = glm::cos(glm::radians(12.5f));
+                spotLight.outerCutOff = glm::cos(glm::radians(17.5f));
+                spotLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+                spotLight.diffuse = glm::vec3(0.6f, 0.6f, 0.3f);
+                spotLight.specular = glm::vec3(0.7f, 0.7f, 0.0f);
+                spotLight.constant = constant;
+                spotLight.linear = linear;
+                spotLight.quadratic = quadratic;
+            }
+
+            glm::vec3 light1Pos = glm::vec3(pointLightPositions[0].x, pointLightPositions[0].y + ligthDirection.y, pointLightPositions[0].z + ligthDirection.x * 3 - 3);
+            lightsData.pointLightCount = options.PointLights;
+            for (unsigned int i = 0; i < options.PointLights; i++)
+            {
+                PointLightData& pointLight = lightsData.pointLights[i];
+                glm::vec3 position = i == 0 ? light1Pos : pointLightPositions[i];
+                pointLight.position = glm::vec3(view * glm::vec4(position, 1.0f));
+                pointLight.ambient = glm::vec3(0.05f, 0.05f, 0.05f);
+                pointLight.diffuse = i == 0 ? glm::vec3(1.0f, 0.0f, 0.0f) : diffuseColor;
+                pointLight.specular = i == 0 ? glm::vec3(1.0f, 0.0f, 0.0f) : lightColor;
+                pointLight.constant = constant;
+                pointLight.linear = linear;
+                pointLight.quadratic = quadratic;
+            }
+            lightUniforms.Update(lightsData);
+
+            // the variant only changes with the light setup, so it's looked up again only then;
+            // a new one compiles in the background while the previous one keeps drawing
+            int key = lightingVariantKey(lightsData, emissionMap != 0);
+            if (key != lightingKey && lightingVariants.Prepare(lightingDefines(key)).IsReady())
+            {
+                lightingShader = &lightingVariants.Get(lightingDefines(key));
+                lightingKey = key;
+            }
+
+            glm::vec3 ligthDir = glm::normalize(glm::mat3(view) * ligthDirection);
+            //LightingShader.setVec3("light.direction", ligthDir);
 
-        glBindVertexArray(lightSourceVAO);
-        model = glm::mat4(1.0f);
-        lightSourceShader.use();
-        lightSourceShader.setMat4("model", model);
-        lightSourceShader.setMat4("view", view);
-        lightSourceShader.setMat4("projection", projection);
-        lightSourceShader.setVec3("color", glm::vec3(1.0f,0.0f,0.0f));
+        
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, light1Pos);
-        model = glm::scale(model, glm::vec3(0.2f));
-        lightSourceShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        lightSourceShader.setVec3("color", lightColor);
-        for (unsigned int i = 1; i < 4; i++)
-        {
+            //glm::vec3 diffuseColor = lightColor * glm::vec3(0.5f);
+            //glm::vec3 ambientColor = diffuseColor * glm::vec3(0.2f);
+           /* LightingShader.setVec3("light.diffuse", glm::vec3(1.0f, 0.0f, 0.0f));
+            LightingShader.setVec3("light.specular", glm::vec3(1.0f, 0.0f, 0.0f));
+            LightingShader.setVec3("light.ambient", 0.2f, 0.2f, 0.2f);*/
+        
+      /*      LightingShader.setFloat("light.constant", 1.0f);
+            LightingShader.setFloat("light.linear", 0.07f);
+            LightingShader.setFloat("light.quadratic", 0.017f);*/
+
+            // the light cubes are left out until their program is linked
+            if (lightSourceColorLocation < 0 && lightSourceShader.IsReady())
+                lightSourceColorLocation = lightSourceShader.getUniformLocation("color");
+            bool lightSourceReady = lightSourceColorLocation >= 0;
+
+            // cull and upload first, then draw in queue order: grouped by program and
+            // textures, nearest first within a group
+            float cubesDepth = cubeInstances.UpdateVisible(cubeInstanceData, cubeBounds, frustum, drawOrder);
+            if (cubeInstances.Count && lightingShader)
+                sceneQueue.Submit(RenderQueue::Key(RENDER_PASS_OPAQUE, lightingShader->SortIndex, 0, cubesDepth), DRAW_CUBES);
+
+            // the red light moves every frame, so it's tested and uploaded directly
             model = glm::mat4(1.0f);
-            model = glm::translate(model, pointLightPositions[i]);
+            model = glm::translate(model, light1Pos);
             model = glm::scale(model, glm::vec3(0.2f));
-            lightSourceShader.setMat4("model", model);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            if (lightSourceReady && frustum.IntersectsBox(cubeBounds.Transformed(model)))
+            {
+                InstanceData redLight = InstanceBuffer::MakeInstance(model);
+                redLightInstance.Update(&redLight, 1);
+                renderStats.Submitted++;
+                sceneQueue.Submit(RenderQueue::Key(RENDER_PASS_OPAQUE, lightSourceShader.SortIndex, 1,
+                    glm::length(light1Pos - camera.Position)), DRAW_RED_LIGHT);
+            }
+            else
+                renderStats.Culled++;
+
+            float pointLightsDepth = pointLightInstances.UpdateVisible(pointLightInstanceData, cubeBounds, frustum, drawOrder);
+            if (pointLightInstances.Count && lightSourceReady)
+                sceneQueue.Submit(RenderQueue::Key(RENDER_PASS_OPAQUE, lightSourceShader.SortIndex, 2, pointLightsDepth), DRAW_POINT_LIGHTS);
+
+            if (drawOrder.Enabled)
+                sceneQueue.Sort();
+            for (size_t i = 0; i < sceneQueue.Size(); ++i)
+            {
+                switch (sceneQueue.Item(i))
+                {
+                case DRAW_CUBES:
+                {
+                    glState.BindVertexArray(VAO);
+                    // a frame without the pre-pass is only slower, so it doesn't wait for its program
+                    bool prepass = depthPrepass && depthOnlyShader.IsReady();
+                    if (prepass)
+                    {
+                        // lay down the nearest depth first, so the lighting shader below only
+                        // runs for the fragment that ends up visible in each pixel
+                        depthOnlyShader.use();
+                        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                        glDrawArraysInstanced(GL_TRIANGLES, 0, 36, cubeInstances.Count);
+                        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                        glDepthFunc(GL_EQUAL);
+                        glDepthMask(GL_FALSE);
+                        renderStats.DrawCalls++;
+                        renderStats.Triangles += 12 * cubeInstances.Count;
+                    }
+                    lightingShader->use();
+                    glState.BindTexture(0, diffuseMap);
+                    glState.BindTexture(1, specularMap);
+                    glState.BindTexture(2, emissionMap);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, cubeInstances.Count);
+                    renderStats.Triangles += 12 * cubeInstances.Count;
+                    if (prepass)
+                    {
+                        glDepthFunc(GL_LESS);
+                        glDepthMask(GL_TRUE);
+                    }
+                    break;
+                }
+                case DRAW_RED_LIGHT:
+                    lightSourceShader.use();
+                    lightSourceShader.setVec3(lightSourceColorLocation, glm::vec3(1.0f, 0.0f, 0.0f));
+                    glState.BindVertexArray(redLightVAO);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, redLightInstance.Count);
+                    renderStats.Triangles += 12;
+                    break;
+                case DRAW_POINT_LIGHTS:
+                    lightSourceShader.use();
+                    lightSourceShader.setVec3(lightSourceColorLocation, lightColor);
+                    glState.BindVertexArray(lightSourceVAO);
+                    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, pointLightInstances.Count);
+                    renderStats.Triangles += 12 * pointLightInstances.Count;
+                    break;
+                }
+                renderStats.DrawCalls++;
+            }
+            sceneQueue.Clear();
         }
 
-
+        if (measured)
+            recorder.EndSubmission();
+#ifdef LEARNOPENGL_HEADLESS
+        context.SwapBuffers();
+#else
         glfwSwapBuffers(window);
         glfwPollEvents();
+#endif
+        if (measured)
+            recorder.EndFrame(renderStats);
+    }
+
+    if (options.Enabled)
+    {
+        recorder.Finish();
+        if (options.Output.empty())
+            recorder.WriteJson(std::cout, options, loadTime * 1000.0);
+        else
+        {
+            std::ofstream output(options.Output);
+            recorder.WriteJson(output, options, loadTime * 1000.0);
+            std::cout << "Benchmark results written to " << options.Output << std::endl;
+        }
+    }
+    else
+    {
+        float renderTime = getTime() - loadTime;
+        std::cout << "Rendered " << totalFrames << " frames, average frame time: "
+            << (totalFrames ? renderTime * 1000.0f / totalFrames : 0.0f) << " ms" << std::endl;
     }
+    if (!options.RecordPath.empty() && recordedPath.Save(options.RecordPath))
+        std::cout << "Camera path recorded to " << options.RecordPath << std::endl;
+    // the model gives its texture references back, then nothing holds them anymore
+    backpackModel.reset();
+    TextureCache::Shared().Evict();
+    for (unsigned int vertexArray : { VAO, lightSourceVAO, redLightVAO })
+        glState.ForgetVertexArray(vertexArray);
     glDeleteVertexArrays(1, &VAO);
     glDeleteVertexArrays(1, &lightSourceVAO);
+    glDeleteVertexArrays(1, &redLightVAO);
     glDeleteBuffers(1, &VBO);
 
+#ifndef LEARNOPENGL_HEADLESS
     glfwTerminate();
+#endif
     return 0;
 }
 
+static bool lightIsOn(const glm::vec3& ambient, const glm::vec3& diffuse, const glm::vec3& specular)
+{
+    return ambient != glm::vec3(0.0f) || diffuse != glm::vec3(0.0f) || specular != glm::vec3(0.0f);
+}
+
+// packs the FragmentShader.frag features a draw needs, cheap enough to compare every frame
+int lightingVariantKey(bool dirLight, bool spotLight, bool emission, int pointLights)
+{
+    return (dirLight ? 1 : 0) | (spotLight ? 2 : 0) | (emission ? 4 : 0) | (pointLights << 3);
+}
+
+// the features the lights and material actually use
+int lightingVariantKey(const LightsBlock& lights, bool emission)
+{
+    return lightingVariantKey(lightIsOn(lights.dirLight.ambient, lights.dirLight.diffuse, lights.dirLight.specular),
+        lightIsOn(lights.spotLight.ambient, lights.spotLight.diffuse, lights.spotLight.specular),
+        emission, lights.pointLightCount);
+}
+
+std::vector<std::string> lightingDefines(int variantKey)
+{
+    std::vector<std::string> defines = { "LIGHTING_FEATURES" };
+    if (variantKey & 1)
+        defines.push_back("DIR_LIGHT");
+    if (variantKey & 2)
+        defines.push_back("SPOT_LIGHT");
+    if (variantKey & 4)
+        defines.push_back("EMISSION_MAP");
+    defines.push_back("POINT_LIGHTS " + std::to_string(variantKey >> 3));
+    return defines;
+}
+
+float getTime()
+{
+#ifdef LEARNOPENGL_HEADLESS
+    return std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+#else
+    return static_cast<float>(glfwGetTime());
+#endif
+}
+
+#ifndef LEARNOPENGL_HEADLESS
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
@@ -420,46 +784,25 @@ void processInput(GLFWwindow* window)
         camera.ProcessKeyboard(LEFT, deltaTime);
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
         camera.ProcessKeyboard(RIGHT, deltaTime);
+
+    // F toggles the flashlight and P the depth pre-pass, once per press
+    static bool flashlightKeyDown = false;
+    bool keyDown = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+    if (keyDown && !flashlightKeyDown)
+        flashlight = !flashlight;
+    flashlightKeyDown = keyDown;
+
+    static bool prepassKeyDown = false;
+    keyDown = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+    if (keyDown && !prepassKeyDown)
+        depthPrepass = !depthPrepass;
+    prepassKeyDown = keyDown;
 }
+#endif
 
 unsigned int loadTexture(char const* path)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-        else
-        {
-            std::cout << "Unsuported number of components" << std::endl;
-            stbi_image_free(data);
-        }
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
\ No newline at end of file
+    // decoded in the background, the returned texture is a placeholder until then; the scene
+    // holds its TextureCache reference for the whole run
+    return TextureCache::Shared().Acquire(path);
+}
@@ -6,8 +6,14 @@
 #include <gtc/matrix_transform.hpp>
 
 #include "Shader.h"
+#include "RenderStats.h"
+#include "GLState.h"
+#include "InstanceBuffer.h"
+#include "Bounds.h"
 
+#include <span>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -23,73 +29,207 @@ struct Texture {
     string path;
 };
 
+// levels of detail a mesh keeps, the full one included
+const unsigned int MAX_MESH_LODS = 5;
+
+// one level of detail: a range of the mesh's indices, relative to its first index, over the
+// same vertices as the full mesh
+struct MeshLod {
+    unsigned int FirstIndex;
+    unsigned int IndexCount;
+    // how far the level may deviate from the full mesh, in mesh space units
+    float Error;
+};
+
+// a run of at most MESHLET_MAX_TRIANGLES consecutive triangles of the full level, with the
+// bounds the cluster culling tests (MeshletBuilder.h, ClusterCuller.h)
+struct Meshlet {
+    unsigned int FirstIndex;
+    unsigned int IndexCount;
+    glm::vec3 Center;
+    float Radius;
+    // every triangle faces within the cone around ConeAxis; ConeCutoff is the sine of its
+    // half angle, 1 when the triangles spread too far for the cone to reject anything
+    glm::vec3 ConeAxis;
+    float ConeCutoff;
+};
+
+// part of a mesh's indices, relative to its first index
+struct IndexRange {
+    unsigned int FirstIndex;
+    unsigned int IndexCount;
+};
+
+// A range of its Model's shared vertex and index buffers (see Model::setupBuffers) plus
+// the textures it's drawn with. Every mesh of a model draws from the same VAO.
 class Mesh {
 public:
     vector<Vertex>       vertices;
     vector<unsigned int> indices;
     vector<Texture>      textures;
-    unsigned int VAO;
-
+    Bounds bounds;
+    unsigned int VAO = 0;
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    // where the mesh starts in the shared buffers and how they store indices, set by SetBufferRange
+    unsigned int baseVertex = 0;
+    unsigned int firstIndex = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    // lods[0] is the full mesh, coarser ones follow it in the index range (MeshSimplifier.h)
+    vector<MeshLod> lods;
+    // clusters of lods[0], in index order
+    vector<Meshlet> meshlets;
+
+    // takes the arrays over; pass them with std::move to avoid copying them
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        vertexCount = static_cast<unsigned int>(this->vertices.size());
+        indexCount = static_cast<unsigned int>(this->indices.size());
+        bounds = computeBounds(this->vertices.data(), this->vertices.size());
+        lods.push_back({ 0, indexCount, 0.0f });
 
-        setupMesh();
+        setupSamplerNames();
     }
 
-    void Draw(Shader& shader)
+    // geometry that stays in memory owned by the caller (e.g. a mapped MeshCache) until
+    // the model uploads it; only its size is kept, vertices and indices stay empty
+    Mesh(std::span<const Vertex> vertices, std::span<const unsigned int> indices, vector<Texture> textures, const Bounds& bounds)
+        : textures(std::move(textures)), bounds(bounds)
     {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        for (unsigned int i = 0; i < textures.size(); ++i)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            string number;
-            string name = textures[i].type;
-            if (name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if (name == "texture_specular")
-                number = std::to_string(specularNr++);
+        vertexCount = static_cast<unsigned int>(vertices.size());
+        indexCount = static_cast<unsigned int>(indices.size());
+        lods.push_back({ 0, indexCount, 0.0f });
 
-            shader.setInt(("material." + name + number).c_str(), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-        glActiveTexture(GL_TEXTURE0);
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        setupSamplerNames();
     }
 
-private:
-    unsigned int VBO, EBO;
+    // frees the CPU copies once the model has uploaded them; counts, bounds, levels and
+    // meshlets stay, which is all drawing needs
+    void ReleaseGeometry()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
 
-    void setupMesh()
+    void SetBufferRange(unsigned int VAO, unsigned int baseVertex, unsigned int firstIndex, GLenum indexType)
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        this->VAO = VAO;
+        this->baseVertex = baseVertex;
+        this->firstIndex = firstIndex;
+        this->indexType = indexType;
+    }
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    static size_t IndexSize(GLenum indexType)
+    {
+        return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : indexType == GL_UNSIGNED_BYTE ? sizeof(GLubyte) : sizeof(GLuint);
+    }
 
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    void Draw(Shader& shader, unsigned int lod = 0)
+    {
+        bindTextures(shader);
+
+        const MeshLod& level = lods[lod];
+        glState.BindVertexArray(VAO);
+        glDrawElementsBaseVertex(GL_TRIANGLES, level.IndexCount, indexType,
+            (void*)((firstIndex + level.FirstIndex) * IndexSize(indexType)), baseVertex);
+        renderStats.DrawCalls++;
+        renderStats.Triangles += level.IndexCount / 3;
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-            &indices[0], GL_STATIC_DRAW);
+    // draws instanceCount instances with one call; the shader reads the per-instance model
+    // and normal matrices from the attributes the caller attached to VAO (InstanceBuffer.h)
+    void DrawInstanced(Shader& shader, unsigned int instanceCount, unsigned int lod = 0)
+    {
+        if (instanceCount == 0)
+            return;
+        bindTextures(shader);
+
+        const MeshLod& level = lods[lod];
+        glState.BindVertexArray(VAO);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.IndexCount, indexType,
+            (void*)((firstIndex + level.FirstIndex) * IndexSize(indexType)), instanceCount, baseVertex);
+        renderStats.DrawCalls++;
+        renderStats.Triangles += level.IndexCount / 3 * instanceCount;
+    }
 
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    // draws parts of the mesh with one glMultiDrawElementsBaseVertex, e.g. the clusters that
+    // survived culling for one instance; the instance attributes are read as for DrawInstanced
+    void DrawRanges(Shader& shader, const IndexRange* ranges, size_t rangeCount)
+    {
+        if (rangeCount == 0)
+            return;
+        bindTextures(shader);
+
+        rangeCounts.resize(rangeCount);
+        rangeOffsets.resize(rangeCount);
+        rangeBaseVertices.assign(rangeCount, static_cast<GLint>(baseVertex));
+        for (size_t i = 0; i < rangeCount; ++i)
+        {
+            rangeCounts[i] = static_cast<GLsizei>(ranges[i].IndexCount);
+            rangeOffsets[i] = (void*)((firstIndex + ranges[i].FirstIndex) * IndexSize(indexType));
+            renderStats.Triangles += ranges[i].IndexCount / 3;
+        }
+        glState.BindVertexArray(VAO);
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, rangeCounts.data(), indexType, rangeOffsets.data(),
+            static_cast<GLsizei>(rangeCount), rangeBaseVertices.data());
+        renderStats.DrawCalls++;
+    }
 
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+private:
+    vector<string> samplerNames;
+    vector<int> samplerLocations;
+    unsigned int samplerProgram = 0;
+    // DrawRanges arguments, kept to reuse their storage
+    vector<GLsizei> rangeCounts;
+    vector<void*> rangeOffsets;
+    vector<GLint> rangeBaseVertices;
+
+    static Bounds computeBounds(const Vertex* vertices, size_t count)
+    {
+        Bounds bounds;
+        if (count == 0)
+            return bounds;
+        bounds.Min = bounds.Max = vertices[0].Position;
+        for (size_t i = 1; i < count; ++i)
+        {
+            bounds.Min = glm::min(bounds.Min, vertices[i].Position);
+            bounds.Max = glm::max(bounds.Max, vertices[i].Position);
+        }
+        return bounds;
+    }
 
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+    void bindTextures(Shader& shader)
+    {
+        // sampler locations are resolved once per program, not per draw
+        if (samplerProgram != shader.ID)
+        {
+            for (unsigned int i = 0; i < textures.size(); ++i)
+                samplerLocations[i] = shader.getUniformLocation(samplerNames[i]);
+            samplerProgram = shader.ID;
+        }
+        for (unsigned int i = 0; i < textures.size(); ++i)
+        {
+            shader.setInt(samplerLocations[i], i);
+            glState.BindTexture(i, textures[i].id);
+        }
+    }
 
-        glBindVertexArray(0);
+    // "material.texture_diffuse1", "material.texture_specular1", ... in texture order
+    void setupSamplerNames()
+    {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        for (unsigned int i = 0; i < textures.size(); ++i)
+        {
+            string number;
+            string name = textures[i].type;
+            if (name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if (name == "texture_specular")
+                number = std::to_string(specularNr++);
+            samplerNames.push_back("material." + name + number);
+        }
+        samplerLocations.assign(textures.size(), -1);
     }
 };
\ No newline at end of file
@@ -0,0 +1,413 @@
+#pragma once
+
+// Binary cache of an imported model, written next to the source asset as
+// "<source>.meshcache" the first time it's imported through Assimp. Later runs map the
+// cache into memory and upload the vertex and index blobs straight from the mapping.
+//
+// Layout (native endianness, every section 16 byte aligned):
+//   MeshCacheHeader
+//   MeshCacheRecord[MeshCount]
+//   uint32_t textureRefs[TextureRefCount]     indices into the texture table, per mesh
+//   MeshCacheTexture[TextureCount]
+//   char strings[StringsSize]                 texture types and paths, not terminated
+//   vertex and index blobs                    addressed by the mesh records
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// bump whenever the import processing or the layout changes, older caches are then rebuilt
+const uint32_t MESH_CACHE_VERSION = 4;
+
+struct MeshCacheHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    uint64_t SourceSize;
+    int64_t SourceTime;
+    uint64_t SourceHash;
+    uint32_t MeshCount;
+    uint32_t TextureCount;
+    uint32_t TextureRefCount;
+    uint32_t StringsSize;
+    uint64_t FileSize;
+};
+
+struct MeshCacheLod
+{
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    float Error;
+};
+
+struct MeshCacheRecord
+{
+    uint32_t VertexCount;
+    uint32_t IndexCount;
+    uint32_t FirstTextureRef;
+    uint32_t TextureRefCount;
+    Bounds MeshBounds;
+    uint64_t VertexOffset;
+    uint64_t IndexOffset;
+    // the levels of detail within the mesh's indices, see Mesh::lods
+    uint32_t LodCount;
+    MeshCacheLod Lods[MAX_MESH_LODS];
+};
+
+struct MeshCacheTexture
+{
+    uint32_t TypeOffset;
+    uint32_t TypeLength;
+    uint32_t PathOffset;
+    uint32_t PathLength;
+};
+
+// read-only mapping of a whole file
+class MappedFile
+{
+public:
+    const unsigned char* Data = nullptr;
+    size_t Size = 0;
+
+    MappedFile() = default;
+    ~MappedFile()
+    {
+        Close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string& path)
+    {
+        Close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            Close();
+            return false;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            Close();
+            return false;
+        }
+        Data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        if (!Data)
+        {
+            Close();
+            return false;
+        }
+        Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            close(fd);
+            return false;
+        }
+        void* address = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file alive on its own
+        close(fd);
+        if (address == MAP_FAILED)
+            return false;
+        Data = static_cast<const unsigned char*>(address);
+        Size = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        if (Data)
+            UnmapViewOfFile(Data);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (Data)
+            munmap(const_cast<unsigned char*>(Data), Size);
+#endif
+        Data = nullptr;
+        Size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+class MeshCache
+{
+public:
+    static std::string PathFor(const std::string& sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // maps the cache of sourcePath; fails if it's missing, corrupt or older than the source.
+    // A source with a new mtime but the same size and contents (e.g. a fresh checkout) is still accepted.
+    bool Open(const std::string& sourcePath)
+    {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!sourceStamp(sourcePath, sourceSize, sourceTime) || !file.Open(PathFor(sourcePath)))
+            return false;
+        if (!validate(sourceSize) || (header->SourceTime != sourceTime && header->SourceHash != hashFile(sourcePath)))
+        {
+            file.Close();
+            return false;
+        }
+        return true;
+    }
+
+    unsigned int MeshCount() const { return header->MeshCount; }
+    const MeshCacheRecord& Record(unsigned int i) const { return records[i]; }
+
+    // views into the mapping, valid while the cache stays open
+    std::span<const Vertex> Vertices(const MeshCacheRecord& record) const
+    {
+        return std::span<const Vertex>(reinterpret_cast<const Vertex*>(file.Data + record.VertexOffset), record.VertexCount);
+    }
+    std::span<const unsigned int> Indices(const MeshCacheRecord& record) const
+    {
+        return std::span<const unsigned int>(reinterpret_cast<const unsigned int*>(file.Data + record.IndexOffset), record.IndexCount);
+    }
+
+    // type and path of the n-th texture referenced by a mesh
+    std::string_view TextureType(const MeshCacheRecord& record, unsigned int n) const
+    {
+        const MeshCacheTexture& texture = textures[textureRefs[record.FirstTextureRef + n]];
+        return std::string_view(strings + texture.TypeOffset, texture.TypeLength);
+    }
+    std::string_view TexturePath(const MeshCacheRecord& record, unsigned int n) const
+    {
+        const MeshCacheTexture& texture = textures[textureRefs[record.FirstTextureRef + n]];
+        return std::string_view(strings + texture.PathOffset, texture.PathLength);
+    }
+
+    // needs the CPU copies of the meshes, so call it before Mesh::ReleaseGeometry
+    static bool Write(const std::string& sourcePath, const vector<Mesh>& meshes)
+    {
+        MeshCacheHeader header = {};
+        std::memcpy(header.Magic, "LOMC", 4);
+        header.Version = MESH_CACHE_VERSION;
+        if (!sourceStamp(sourcePath, header.SourceSize, header.SourceTime))
+            return false;
+        header.SourceHash = hashFile(sourcePath);
+        header.MeshCount = static_cast<uint32_t>(meshes.size());
+
+        // texture table shared by all meshes, deduplicated on type and path
+        std::vector<MeshCacheRecord> records(meshes.size());
+        std::vector<uint32_t> textureRefs;
+        std::vector<MeshCacheTexture> textureTable;
+        std::vector<std::pair<std::string, std::string>> textureKeys;
+        std::string strings;
+        for (size_t i = 0; i < meshes.size(); ++i)
+        {
+            const Mesh& mesh = meshes[i];
+            records[i].VertexCount = static_cast<uint32_t>(mesh.vertices.size());
+            records[i].IndexCount = static_cast<uint32_t>(mesh.indices.size());
+            records[i].FirstTextureRef = static_cast<uint32_t>(textureRefs.size());
+            records[i].TextureRefCount = static_cast<uint32_t>(mesh.textures.size());
+            records[i].MeshBounds = mesh.bounds;
+            records[i].LodCount = static_cast<uint32_t>(std::min<size_t>(mesh.lods.size(), MAX_MESH_LODS));
+            for (uint32_t lod = 0; lod < records[i].LodCount; ++lod)
+                records[i].Lods[lod] = { mesh.lods[lod].FirstIndex, mesh.lods[lod].IndexCount, mesh.lods[lod].Error };
+            for (const Texture& texture : mesh.textures)
+            {
+                std::pair<std::string, std::string> key(texture.type, texture.path);
+                size_t index = 0;
+                while (index < textureKeys.size() && textureKeys[index] != key)
+                    ++index;
+                if (index == textureKeys.size())
+                {
+                    MeshCacheTexture entry;
+                    entry.TypeOffset = static_cast<uint32_t>(strings.size());
+                    entry.TypeLength = static_cast<uint32_t>(texture.type.size());
+                    strings += texture.type;
+                    entry.PathOffset = static_cast<uint32_t>(strings.size());
+                    entry.PathLength = static_cast<uint32_t>(texture.path.size());
+                    strings += texture.path;
+                    textureTable.push_back(entry);
+                    textureKeys.push_back(key);
+                }
+                textureRefs.push_back(static_cast<uint32_t>(index));
+            }
+        }
+        header.TextureCount = static_cast<uint32_t>(textureTable.size());
+        header.TextureRefCount = static_cast<uint32_t>(textureRefs.size());
+        header.StringsSize = static_cast<uint32_t>(strings.size());
+
+        uint64_t offset = align(sizeof(MeshCacheHeader));
+        offset = align(offset + records.size() * sizeof(MeshCacheRecord));
+        offset = align(offset + textureRefs.size() * sizeof(uint32_t));
+        offset = align(offset + textureTable.size() * sizeof(MeshCacheTexture));
+        offset = align(offset + strings.size());
+        for (size_t i = 0; i < meshes.size(); ++i)
+        {
+            records[i].VertexOffset = offset;
+            offset = align(offset + records[i].VertexCount * sizeof(Vertex));
+            records[i].IndexOffset = offset;
+            offset = align(offset + records[i].IndexCount * sizeof(unsigned int));
+        }
+        header.FileSize = offset;
+
+        // written under a temporary name so an interrupted write never leaves a truncated cache behind
+        std::string cachePath = PathFor(sourcePath);
+        std::string tempPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            writeAligned(out, &header, sizeof(header));
+            writeAligned(out, records.data(), records.size() * sizeof(MeshCacheRecord));
+            writeAligned(out, textureRefs.data(), textureRefs.size() * sizeof(uint32_t));
+            writeAligned(out, textureTable.data(), textureTable.size() * sizeof(MeshCacheTexture));
+            writeAligned(out, strings.data(), strings.size());
+            for (const Mesh& mesh : meshes)
+            {
+                writeAligned(out, mesh.vertices.data(), mesh.vertices.size() * sizeof(Vertex));
+                writeAligned(out, mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+            }
+            if (!out)
+                return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        return !error;
+    }
+
+private:
+    MappedFile file;
+    const MeshCacheHeader* header = nullptr;
+    const MeshCacheRecord* records = nullptr;
+    const uint32_t* textureRefs = nullptr;
+    const MeshCacheTexture* textures = nullptr;
+    const char* strings = nullptr;
+
+    static uint64_t align(uint64_t offset)
+    {
+        return (offset + 15) & ~uint64_t(15);
+    }
+
+    static void writeAligned(std::ofstream& out, const void* data, size_t size)
+    {
+        static const char zeros[16] = {};
+        if (size)
+            out.write(static_cast<const char*>(data), size);
+        out.write(zeros, align(size) - size);
+    }
+
+    static bool sourceStamp(const std::string& path, uint64_t& size, int64_t& time)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+            return false;
+        time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        return !error;
+    }
+
+    // FNV-1a over the whole source file
+    static uint64_t hashFile(const std::string& path)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        MappedFile source;
+        if (!source.Open(path))
+            return hash;
+        for (size_t i = 0; i < source.Size; ++i)
+        {
+            hash ^= source.Data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // checks the header against the source and every table and blob against the file size,
+    // so a truncated or foreign file is rejected instead of read out of bounds
+    bool validate(uint64_t sourceSize)
+    {
+        if (file.Size < sizeof(MeshCacheHeader))
+            return false;
+        header = reinterpret_cast<const MeshCacheHeader*>(file.Data);
+        if (std::memcmp(header->Magic, "LOMC", 4) != 0 || header->Version != MESH_CACHE_VERSION
+            || header->FileSize != file.Size || header->SourceSize != sourceSize)
+            return false;
+
+        uint64_t offset = align(sizeof(MeshCacheHeader));
+        records = reinterpret_cast<const MeshCacheRecord*>(file.Data + offset);
+        offset = align(offset + uint64_t(header->MeshCount) * sizeof(MeshCacheRecord));
+        textureRefs = reinterpret_cast<const uint32_t*>(file.Data + offset);
+        offset = align(offset + uint64_t(header->TextureRefCount) * sizeof(uint32_t));
+        textures = reinterpret_cast<const MeshCacheTexture*>(file.Data + offset);
+        offset = align(offset + uint64_t(header->TextureCount) * sizeof(MeshCacheTexture));
+        strings = reinterpret_cast<const char*>(file.Data + offset);
+        offset += header->StringsSize;
+        if (offset > file.Size)
+            return false;
+
+        for (uint32_t i = 0; i < header->TextureRefCount; ++i)
+            if (textureRefs[i] >= header->TextureCount)
+                return false;
+        for (uint32_t i = 0; i < header->TextureCount; ++i)
+        {
+            const MeshCacheTexture& texture = textures[i];
+            if (uint64_t(texture.TypeOffset) + texture.TypeLength > header->StringsSize
+                || uint64_t(texture.PathOffset) + texture.PathLength > header->StringsSize)
+                return false;
+        }
+        for (uint32_t i = 0; i < header->MeshCount; ++i)
+        {
+            const MeshCacheRecord& record = records[i];
+            if (uint64_t(record.FirstTextureRef) + record.TextureRefCount > header->TextureRefCount
+                || record.VertexOffset + uint64_t(record.VertexCount) * sizeof(Vertex) > file.Size
+                || record.IndexOffset + uint64_t(record.IndexCount) * sizeof(unsigned int) > file.Size
+                || record.LodCount == 0 || record.LodCount > MAX_MESH_LODS)
+                return false;
+            for (uint32_t lod = 0; lod < record.LodCount; ++lod)
+                if (uint64_t(record.Lods[lod].FirstIndex) + record.Lods[lod].IndexCount > record.IndexCount)
+                    return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,427 @@
+#pragma once
+
+// Import time optimization of an indexed triangle list, run on each mesh before it's
+// cached:
+//   1. WeldVertices drops bitwise duplicate vertices.
+//   2. OptimizeVertexCache reorders triangles for the post-transform vertex cache
+//      (Tipsify, Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and
+//      Reduced Overdraw").
+//   3. OptimizeOverdraw splits that order into clusters at cache flushes and sorts the
+//      clusters so the ones facing out of the mesh are drawn first, from the same paper.
+//   4. OptimizeVertexFetch renumbers vertices in first use order for fetch locality.
+// SplitByVertexCount then cuts meshes too large for 16 bit indices into chunks.
+// AnalyzeVertexCache simulates a FIFO cache to report ACMR (vertices transformed per
+// triangle) and ATVR (vertices transformed per vertex, 1 is ideal).
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// post-transform cache size assumed by the optimizer and the statistics
+const unsigned int VERTEX_CACHE_SIZE = 16;
+// a cluster may be split for overdraw while its ACMR stays within this factor
+const float OVERDRAW_THRESHOLD = 1.05f;
+// vertices 16 bit indices can address
+const size_t MAX_CHUNK_VERTICES = 65536;
+
+struct VertexCacheStatistics
+{
+    unsigned int VerticesTransformed = 0;
+    float ACMR = 0.0f;
+    float ATVR = 0.0f;
+};
+
+struct MeshOptimizerReport
+{
+    size_t VerticesBefore = 0;
+    size_t VerticesAfter = 0;
+    VertexCacheStatistics Before;
+    VertexCacheStatistics After;
+};
+
+struct MeshChunk
+{
+    std::vector<Vertex> Vertices;
+    std::vector<unsigned int> Indices;
+    // filled by MeshSimplifier::BuildLods, whose levels are appended to Indices
+    std::vector<MeshLod> Lods;
+};
+
+class MeshOptimizer
+{
+public:
+    // all four passes, in order
+    static MeshOptimizerReport Optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        MeshOptimizerReport report;
+        report.VerticesBefore = vertices.size();
+        report.Before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+        WeldVertices(vertices, indices);
+        OptimizeVertexCache(indices, vertices.size());
+        OptimizeOverdraw(vertices, indices);
+        OptimizeVertexFetch(vertices, indices);
+
+        report.VerticesAfter = vertices.size();
+        report.After = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+        return report;
+    }
+
+    static VertexCacheStatistics AnalyzeVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount,
+        unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        VertexCacheStatistics statistics;
+        if (indexCount < 3 || vertexCount == 0)
+            return statistics;
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t i = 0; i < indexCount; ++i)
+            statistics.VerticesTransformed += cache.Access(indices[i]) ? 0 : 1;
+        statistics.ACMR = static_cast<float>(statistics.VerticesTransformed) / static_cast<float>(indexCount / 3);
+        statistics.ATVR = static_cast<float>(statistics.VerticesTransformed) / static_cast<float>(vertexCount);
+        return statistics;
+    }
+
+    // merges vertices whose attributes are bitwise identical
+    static void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> unique;
+        unique.reserve(vertices.size());
+        std::vector<unsigned int> remap(vertices.size());
+        std::vector<Vertex> welded;
+        welded.reserve(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            auto inserted = unique.emplace(vertices[i], static_cast<unsigned int>(welded.size()));
+            if (inserted.second)
+                welded.push_back(vertices[i]);
+            remap[i] = inserted.first->second;
+        }
+        for (unsigned int& index : indices)
+            index = remap[index];
+        vertices.swap(welded);
+    }
+
+    // Tipsify: fans around the most recently used vertex whose remaining triangles still fit
+    // in the cache, falling back to recently emitted vertices and then to input order
+    static void OptimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+        unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return;
+
+        // triangles adjacent to each vertex, as offsets into one array
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; ++v)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+        std::vector<unsigned int> adjacency(indices.size());
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t t = 0; t < triangleCount; ++t)
+            for (size_t k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnd;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+
+        unsigned int time = cacheSize + 1;
+        size_t cursor = 0;
+        int fanning = 0;
+        while (fanning >= 0)
+        {
+            candidates.clear();
+            for (unsigned int a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a)
+            {
+                unsigned int t = adjacency[a];
+                if (emitted[t])
+                    continue;
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    unsigned int v = indices[t * 3 + k];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (time - cacheTime[v] > cacheSize)
+                        cacheTime[v] = time++;
+                }
+                emitted[t] = true;
+            }
+
+            // the candidate that stays in the cache the longest after fanning around it
+            int next = -1;
+            int best = -1;
+            for (unsigned int v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = static_cast<int>(time - cacheTime[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    next = static_cast<int>(v);
+                }
+            }
+            if (next < 0)
+                next = skipDeadEnd(liveTriangles, deadEnd, cursor);
+            fanning = next;
+        }
+        indices.swap(output);
+    }
+
+    // keeps the cache friendly order within clusters and sorts the clusters by how much
+    // they face away from the mesh center, outside first
+    static void OptimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices,
+        float threshold = OVERDRAW_THRESHOLD, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2 || vertices.empty())
+            return;
+
+        std::vector<unsigned int> clusters = findClusters(indices, vertices.size(), threshold, cacheSize);
+        clusters.push_back(static_cast<unsigned int>(triangleCount));
+        size_t clusterCount = clusters.size() - 1;
+        if (clusterCount < 2)
+            return;
+
+        // area weighted centroids and normals
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        std::vector<glm::vec3> clusterCentroid(clusterCount, glm::vec3(0.0f));
+        std::vector<glm::vec3> clusterNormal(clusterCount, glm::vec3(0.0f));
+        std::vector<float> clusterArea(clusterCount, 0.0f);
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            for (unsigned int t = clusters[c]; t < clusters[c + 1]; ++t)
+            {
+                const glm::vec3& p0 = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float area = glm::length(normal);
+                glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+                clusterCentroid[c] += centroid * area;
+                clusterNormal[c] += normal;
+                clusterArea[c] += area;
+            }
+            meshCentroid += clusterCentroid[c];
+            meshArea += clusterArea[c];
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        std::vector<float> sortKey(clusterCount);
+        for (size_t c = 0; c < clusterCount; ++c)
+        {
+            glm::vec3 centroid = clusterArea[c] > 0.0f ? clusterCentroid[c] / clusterArea[c] : meshCentroid;
+            float length = glm::length(clusterNormal[c]);
+            glm::vec3 normal = length > 0.0f ? clusterNormal[c] / length : glm::vec3(0.0f);
+            sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+        }
+        std::vector<unsigned int> order(clusterCount);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+        for (unsigned int c : order)
+            output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        indices.swap(output);
+    }
+
+    // renumbers vertices in the order the index buffer first uses them; unused ones are dropped
+    static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+    {
+        const unsigned int unused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<Vertex> ordered;
+        ordered.reserve(vertices.size());
+        for (unsigned int& index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = static_cast<unsigned int>(ordered.size());
+                ordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(ordered);
+    }
+
+    // cuts a triangle list into chunks that reference at most maxVertices vertices each,
+    // keeping the triangle order; a mesh that already fits comes back as its only chunk
+    static std::vector<MeshChunk> SplitByVertexCount(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
+        size_t maxVertices = MAX_CHUNK_VERTICES)
+    {
+        std::vector<MeshChunk> chunks;
+        if (vertices.size() <= maxVertices)
+        {
+            chunks.push_back({ std::move(vertices), std::move(indices), {} });
+            return chunks;
+        }
+
+        // chunk local index of each source vertex, renumbered in first use order
+        const unsigned int unused = ~0u;
+        std::vector<unsigned int> remap(vertices.size(), unused);
+        std::vector<unsigned int> referenced;
+        MeshChunk chunk;
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            const unsigned int* triangle = &indices[t];
+            size_t added = 0;
+            for (size_t k = 0; k < 3; ++k)
+                if (remap[triangle[k]] == unused && (k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[2] != triangle[1]))
+                    ++added;
+            if (chunk.Vertices.size() + added > maxVertices)
+            {
+                chunks.push_back(std::move(chunk));
+                chunk = MeshChunk();
+                for (unsigned int v : referenced)
+                    remap[v] = unused;
+                referenced.clear();
+            }
+            for (size_t k = 0; k < 3; ++k)
+            {
+                unsigned int v = triangle[k];
+                if (remap[v] == unused)
+                {
+                    remap[v] = static_cast<unsigned int>(chunk.Vertices.size());
+                    chunk.Vertices.push_back(vertices[v]);
+                    referenced.push_back(v);
+                }
+                chunk.Indices.push_back(remap[v]);
+            }
+        }
+        if (!chunk.Indices.empty())
+            chunks.push_back(std::move(chunk));
+        return chunks;
+    }
+
+private:
+    struct VertexHash
+    {
+        size_t operator()(const Vertex& vertex) const
+        {
+            // FNV-1a over the attribute bytes
+            const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    struct VertexEqual
+    {
+        bool operator()(const Vertex& a, const Vertex& b) const
+        {
+            return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+
+    // FIFO post-transform cache; an entry is resident while fewer than size misses followed it
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount, unsigned int size) : insertedAt(vertexCount, 0), size(size) {}
+
+        // true on a hit
+        bool Access(unsigned int vertex)
+        {
+            if (insertedAt[vertex] != 0 && misses - insertedAt[vertex] < size)
+                return true;
+            insertedAt[vertex] = ++misses;
+            return false;
+        }
+
+        void Reset()
+        {
+            // pushing every entry out is the same as emptying the cache
+            misses += size;
+        }
+
+    private:
+        std::vector<unsigned int> insertedAt;
+        unsigned int misses = 0;
+        unsigned int size;
+    };
+
+    static int skipDeadEnd(const std::vector<unsigned int>& liveTriangles, std::vector<unsigned int>& deadEnd, size_t& cursor)
+    {
+        while (!deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                return static_cast<int>(v);
+        }
+        for (; cursor < liveTriangles.size(); ++cursor)
+        {
+            if (liveTriangles[cursor] > 0)
+                return static_cast<int>(cursor);
+        }
+        return -1;
+    }
+
+    // first triangle of each cluster: hard boundaries where a triangle misses on all three
+    // vertices (the cache flushed), then soft ones inside those wherever the ACMR so far is
+    // within threshold of the whole cluster's
+    static std::vector<unsigned int> findClusters(const std::vector<unsigned int>& indices, size_t vertexCount,
+        float threshold, unsigned int cacheSize)
+    {
+        size_t triangleCount = indices.size() / 3;
+        std::vector<unsigned int> hard;
+        FifoCache cache(vertexCount, cacheSize);
+        for (size_t t = 0; t < triangleCount; ++t)
+        {
+            unsigned int misses = 0;
+            for (size_t k = 0; k < 3; ++k)
+                misses += cache.Access(indices[t * 3 + k]) ? 0 : 1;
+            if (t == 0 || misses == 3)
+                hard.push_back(static_cast<unsigned int>(t));
+        }
+        hard.push_back(static_cast<unsigned int>(triangleCount));
+
+        std::vector<unsigned int> clusters;
+        for (size_t h = 0; h + 1 < hard.size(); ++h)
+        {
+            unsigned int start = hard[h], end = hard[h + 1];
+            cache.Reset();
+            unsigned int clusterMisses = 0;
+            for (unsigned int t = start; t < end; ++t)
+                for (size_t k = 0; k < 3; ++k)
+                    clusterMisses += cache.Access(indices[t * 3 + k]) ? 0 : 1;
+            float clusterACMR = static_cast<float>(clusterMisses) / static_cast<float>(end - start);
+
+            clusters.push_back(start);
+            cache.Reset();
+            unsigned int misses = 0, first = start;
+            for (unsigned int t = start; t < end; ++t)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                    misses += cache.Access(indices[t * 3 + k]) ? 0 : 1;
+                if (t + 1 < end && static_cast<float>(misses) <= threshold * clusterACMR * static_cast<float>(t + 1 - first))
+                {
+                    clusters.push_back(t + 1);
+                    cache.Reset();
+                    misses = 0;
+                    first = t + 1;
+                }
+            }
+        }
+        return clusters;
+    }
+};
@@ -0,0 +1,303 @@
+#pragma once
+
+// Level of detail generation by quadric error metric edge collapse (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics"). Collapses are half edge: a vertex
+// merges into a neighbour and no vertex is moved or created, so every level indexes the
+// vertices of the full mesh and only adds indices to the model's buffers.
+// Vertices on open borders and attribute seams (several vertices at one position) are
+// locked, which keeps silhouettes of open meshes and UV seams intact.
+
+#include "Mesh.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// each level aims for this fraction of the previous level's triangles
+const float LOD_REDUCTION = 0.5f;
+// a level that can't get below this fraction of the previous one isn't worth keeping
+const float LOD_MIN_REDUCTION = 0.8f;
+// levels stop once their error passes this fraction of the mesh's bounding radius
+const float LOD_MAX_ERROR = 0.1f;
+
+class MeshSimplifier
+{
+public:
+    // appends the coarser levels to indices, each vertex cache optimized, and describes all
+    // levels, the full one first, in lods
+    static void BuildLods(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, std::vector<MeshLod>& lods,
+        unsigned int maxLods = MAX_MESH_LODS)
+    {
+        lods.assign(1, { 0, static_cast<unsigned int>(indices.size()), 0.0f });
+        if (vertices.empty() || indices.size() < 3)
+            return;
+
+        glm::vec3 min = vertices[0].Position, max = vertices[0].Position;
+        for (const Vertex& vertex : vertices)
+        {
+            min = glm::min(min, vertex.Position);
+            max = glm::max(max, vertex.Position);
+        }
+        float maxError = glm::length(max - min) * 0.5f * LOD_MAX_ERROR;
+
+        std::vector<unsigned int> previous(indices);
+        float error = 0.0f;
+        for (unsigned int level = 1; level < maxLods; ++level)
+        {
+            size_t target = static_cast<size_t>(previous.size() / 3 * LOD_REDUCTION) * 3;
+            float levelError = 0.0f;
+            // each level is simplified from the previous one, so their errors add up
+            std::vector<unsigned int> simplified = Simplify(vertices, previous, target, maxError - error, levelError);
+            if (simplified.empty() || simplified.size() > previous.size() * LOD_MIN_REDUCTION)
+                break;
+            MeshOptimizer::OptimizeVertexCache(simplified, vertices.size());
+            error += levelError;
+            lods.push_back({ static_cast<unsigned int>(indices.size()), static_cast<unsigned int>(simplified.size()), error });
+            indices.insert(indices.end(), simplified.begin(), simplified.end());
+            previous.swap(simplified);
+        }
+    }
+
+    // collapses edges, cheapest first, until at most targetIndexCount indices remain or the
+    // next collapse would move the surface further than maxError; error receives the largest
+    // deviation introduced
+    static std::vector<unsigned int> Simplify(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& sourceIndices,
+        size_t targetIndexCount, float maxError, float& error)
+    {
+        error = 0.0f;
+        std::vector<unsigned int> indices(sourceIndices);
+        size_t vertexCount = vertices.size();
+        if (maxError <= 0.0f)
+            return indices;
+
+        std::vector<bool> locked = findLockedVertices(vertices, indices);
+
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            Quadric plane = Quadric::FromTriangle(vertices[indices[t]].Position, vertices[indices[t + 1]].Position,
+                vertices[indices[t + 2]].Position);
+            for (size_t k = 0; k < 3; ++k)
+                quadrics[indices[t + k]].Add(plane);
+        }
+
+        std::vector<unsigned int> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<Collapse> collapses;
+        std::vector<unsigned int> adjacencyOffset, adjacency;
+        double maxCost = static_cast<double>(maxError) * maxError;
+
+        // passes of independent collapses, cheapest first, until the target is met or nothing is left
+        while (indices.size() > targetIndexCount)
+        {
+            buildAdjacency(indices, vertexCount, adjacencyOffset, adjacency);
+
+            collapses.clear();
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                for (size_t k = 0; k < 3; ++k)
+                {
+                    unsigned int a = indices[t + k], b = indices[t + (k + 1) % 3];
+                    for (int direction = 0; direction < 2; ++direction, std::swap(a, b))
+                    {
+                        if (locked[a] || a == b)
+                            continue;
+                        Quadric combined = quadrics[a];
+                        combined.Add(quadrics[b]);
+                        double cost = combined.Error(vertices[b].Position);
+                        if (cost <= maxCost)
+                            collapses.push_back({ a, b, cost });
+                    }
+                }
+            }
+            if (collapses.empty())
+                break;
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Cost < y.Cost; });
+
+            for (size_t v = 0; v < vertexCount; ++v)
+                remap[v] = static_cast<unsigned int>(v);
+            std::fill(touched.begin(), touched.end(), false);
+            // each collapse removes about two triangles
+            size_t removable = (indices.size() - targetIndexCount) / 3;
+            size_t applied = 0;
+            for (const Collapse& collapse : collapses)
+            {
+                if (applied * 2 >= removable)
+                    break;
+                if (touched[collapse.From] || touched[collapse.To])
+                    continue;
+                if (flipsTriangle(vertices, indices, adjacencyOffset, adjacency, collapse.From, collapse.To))
+                    continue;
+
+                remap[collapse.From] = collapse.To;
+                quadrics[collapse.To].Add(quadrics[collapse.From]);
+                error = std::max(error, static_cast<float>(std::sqrt(collapse.Cost)));
+                // the neighbourhood's triangles change, their costs are stale until the next pass
+                for (unsigned int a = adjacencyOffset[collapse.From]; a < adjacencyOffset[collapse.From + 1]; ++a)
+                    for (size_t k = 0; k < 3; ++k)
+                        touched[indices[adjacency[a] * 3 + k]] = true;
+                ++applied;
+            }
+            if (applied == 0)
+                break;
+
+            size_t kept = 0;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                indices[kept++] = a;
+                indices[kept++] = b;
+                indices[kept++] = c;
+            }
+            indices.resize(kept);
+        }
+        return indices;
+    }
+
+private:
+    // symmetric 4x4 matrix of the summed squared distances to a set of planes, area weighted
+    struct Quadric
+    {
+        double A00 = 0, A01 = 0, A02 = 0, A11 = 0, A12 = 0, A22 = 0;
+        double B0 = 0, B1 = 0, B2 = 0;
+        double C = 0;
+        double Weight = 0;
+
+        static Quadric FromTriangle(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+        {
+            Quadric q;
+            glm::vec3 cross = glm::cross(p1 - p0, p2 - p0);
+            double length = glm::length(cross);
+            if (length == 0.0)
+                return q;
+            double nx = cross.x / length, ny = cross.y / length, nz = cross.z / length;
+            double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+            double w = length * 0.5;
+            q.A00 = w * nx * nx; q.A01 = w * nx * ny; q.A02 = w * nx * nz;
+            q.A11 = w * ny * ny; q.A12 = w * ny * nz; q.A22 = w * nz * nz;
+            q.B0 = w * nx * d; q.B1 = w * ny * d; q.B2 = w * nz * d;
+            q.C = w * d * d;
+            q.Weight = w;
+            return q;
+        }
+
+        void Add(const Quadric& q)
+        {
+            A00 += q.A00; A01 += q.A01; A02 += q.A02; A11 += q.A11; A12 += q.A12; A22 += q.A22;
+            B0 += q.B0; B1 += q.B1; B2 += q.B2;
+            C += q.C;
+            Weight += q.Weight;
+        }
+
+        // mean squared distance of p to the planes
+        double Error(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double e = A00 * x * x + A11 * y * y + A22 * z * z + 2 * (A01 * x * y + A02 * x * z + A12 * y * z)
+                + 2 * (B0 * x + B1 * y + B2 * z) + C;
+            return Weight > 0 ? std::max(0.0, e) / Weight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        unsigned int From;
+        unsigned int To;
+        double Cost;
+    };
+
+    // vertices sharing a position with another (attribute seams) and vertices on edges with
+    // other than two triangles (borders, non-manifold edges) must stay
+    static std::vector<bool> findLockedVertices(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
+    {
+        std::vector<bool> locked(vertices.size(), false);
+        std::unordered_map<uint64_t, unsigned int> positions;
+        std::vector<unsigned int> positionOf(vertices.size());
+        std::vector<unsigned int> positionUses;
+        for (size_t v = 0; v < vertices.size(); ++v)
+        {
+            auto inserted = positions.emplace(positionKey(vertices[v].Position), static_cast<unsigned int>(positionUses.size()));
+            if (inserted.second)
+                positionUses.push_back(0);
+            positionOf[v] = inserted.first->second;
+            positionUses[positionOf[v]]++;
+        }
+
+        std::unordered_map<uint64_t, unsigned int> edges;
+        edges.reserve(indices.size());
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            for (size_t k = 0; k < 3; ++k)
+            {
+                unsigned int a = positionOf[indices[t + k]], b = positionOf[indices[t + (k + 1) % 3]];
+                edges[(static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b)]++;
+            }
+        }
+        std::vector<bool> lockedPosition(positionUses.size(), false);
+        for (const auto& edge : edges)
+        {
+            if (edge.second != 2)
+            {
+                lockedPosition[edge.first >> 32] = true;
+                lockedPosition[edge.first & 0xFFFFFFFFu] = true;
+            }
+        }
+        for (size_t v = 0; v < vertices.size(); ++v)
+            locked[v] = positionUses[positionOf[v]] > 1 || lockedPosition[positionOf[v]];
+        return locked;
+    }
+
+    static uint64_t positionKey(const glm::vec3& position)
+    {
+        // FNV-1a over the coordinate bits; a collision only locks a vertex needlessly
+        uint32_t bits[3];
+        std::memcpy(bits, &position, sizeof(bits));
+        uint64_t hash = 14695981039346656037ull;
+        for (uint32_t word : bits)
+            hash = (hash ^ word) * 1099511628211ull;
+        return hash;
+    }
+
+    static void buildAdjacency(const std::vector<unsigned int>& indices, size_t vertexCount,
+        std::vector<unsigned int>& offset, std::vector<unsigned int>& adjacency)
+    {
+        offset.assign(vertexCount + 1, 0);
+        for (unsigned int index : indices)
+            offset[index + 1]++;
+        for (size_t v = 0; v < vertexCount; ++v)
+            offset[v + 1] += offset[v];
+        adjacency.resize(indices.size());
+        std::vector<unsigned int> fill(offset.begin(), offset.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    // true if moving from onto to turns one of from's remaining triangles over
+    static bool flipsTriangle(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+        const std::vector<unsigned int>& offset, const std::vector<unsigned int>& adjacency, unsigned int from, unsigned int to)
+    {
+        for (unsigned int a = offset[from]; a < offset[from + 1]; ++a)
+        {
+            const unsigned int* triangle = &indices[adjacency[a] * 3];
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = vertices[triangle[k]].Position;
+                q[k] = triangle[k] == from ? vertices[to].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// sizes that fit the on-chip limits mesh shading hardware was designed around; on the CPU
+// they trade culling granularity against the number of bounds tested per instance
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+// cones with triangles spread further than this (cosine) from their axis can't reject
+// anything in practice, and their cutoff is numerically unreliable
+const float MESHLET_MIN_CONE_SPREAD = 0.1f;
+
+// Cuts the full level of a mesh into meshlets. The triangles are already in vertex cache
+// order (MeshOptimizer.h), which keeps neighbours together, so meshlets are consecutive runs
+// of it and the index buffer is left untouched.
+class MeshletBuilder
+{
+public:
+    static std::vector<Meshlet> Build(const Vertex* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount)
+    {
+        std::vector<Meshlet> meshlets;
+        // meshlet each vertex was last counted in, so testing membership needs no clearing
+        std::vector<unsigned int> stamp(vertexCount, ~0u);
+        unsigned int first = 0, vertexTotal = 0;
+        for (size_t t = 0; t + 2 < indexCount; t += 3)
+        {
+            unsigned int current = static_cast<unsigned int>(meshlets.size());
+            unsigned int added = 0;
+            for (size_t k = 0; k < 3; ++k)
+                if (stamp[indices[t + k]] != current && (k == 0 || indices[t + k] != indices[t]) && (k < 2 || indices[t + 2] != indices[t + 1]))
+                    ++added;
+            unsigned int triangles = static_cast<unsigned int>(t - first) / 3;
+            if (vertexTotal + added > MESHLET_MAX_VERTICES || triangles == MESHLET_MAX_TRIANGLES)
+            {
+                meshlets.push_back(describe(vertices, indices, first, static_cast<unsigned int>(t) - first));
+                first = static_cast<unsigned int>(t);
+                vertexTotal = 0;
+                ++current;
+            }
+            for (size_t k = 0; k < 3; ++k)
+            {
+                if (stamp[indices[t + k]] != current)
+                {
+                    stamp[indices[t + k]] = current;
+                    ++vertexTotal;
+                }
+            }
+        }
+        size_t end = indexCount - indexCount % 3;
+        if (end > first)
+            meshlets.push_back(describe(vertices, indices, first, static_cast<unsigned int>(end) - first));
+        return meshlets;
+    }
+
+private:
+    static Meshlet describe(const Vertex* vertices, const unsigned int* indices, unsigned int first, unsigned int count)
+    {
+        Meshlet meshlet;
+        meshlet.FirstIndex = first;
+        meshlet.IndexCount = count;
+
+        // sphere around the box center, looser than a minimal one but cheap
+        glm::vec3 min = vertices[indices[first]].Position, max = min;
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            min = glm::min(min, vertices[indices[i]].Position);
+            max = glm::max(max, vertices[indices[i]].Position);
+        }
+        meshlet.Center = (min + max) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (unsigned int i = first; i < first + count; ++i)
+        {
+            glm::vec3 offset = vertices[indices[i]].Position - meshlet.Center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        meshlet.Radius = std::sqrt(radiusSquared);
+
+        // cone: the average face normal, opened up to the normal furthest from it
+        std::vector<glm::vec3> normals;
+        normals.reserve(count / 3);
+        glm::vec3 sum(0.0f);
+        for (unsigned int i = first; i + 2 < first + count; i += 3)
+        {
+            const glm::vec3& p0 = vertices[indices[i]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - p0, vertices[indices[i + 2]].Position - p0);
+            float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+            normals.push_back(normal / length);
+            sum += normals.back();
+        }
+        meshlet.ConeAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+        meshlet.ConeCutoff = 1.0f;
+        float sumLength = glm::length(sum);
+        if (normals.empty() || sumLength == 0.0f)
+            return meshlet;
+        meshlet.ConeAxis = sum / sumLength;
+        float minDot = 1.0f;
+        for (const glm::vec3& normal : normals)
+            minDot = std::min(minDot, glm::dot(normal, meshlet.ConeAxis));
+        if (minDot > MESHLET_MIN_CONE_SPREAD)
+            meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+        return meshlet;
+    }
+};
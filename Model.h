@@ -6,137 +6,581 @@
 #include "stb_image.h"
 
 #include "Shader.h"
+#include "GLState.h"
 #include "Mesh.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "IndirectBatch.h"
+#include "LodSelector.h"
+#include "ClusterCuller.h"
+#include "RenderQueue.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+#include "ThreadPool.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+
+#include <future>
+#include <memory>
+#include <span>
 
 unsigned int TextureFromFile(const char* path, const string& directory, bool gamma = false);
 
+// texture named by a material, resolved to a GL texture on the context thread
+struct TextureRef
+{
+	string type;
+	string path;
+};
+
+// CPU side result of converting one aiMesh, before any GL object exists; meshes with more
+// vertices than 16 bit indices address come in several parts, each becoming its own Mesh
+struct MeshData
+{
+	vector<MeshChunk> parts;
+	vector<TextureRef> textures;
+	MeshOptimizerReport optimization;
+};
+
+// All meshes of a model share one VAO with one interleaved vertex buffer and one index
+// buffer; each Mesh is a base vertex/first index range drawn with glDrawElementsBaseVertex,
+// so drawing the model binds a single VAO instead of one per mesh.
+// With VERTEX_FORMAT_PACKED the buffer holds PackedVertex quantized to the model's bounds;
+// the model shaders decode it from the uniforms every draw method sets.
+// Once uploaded, the meshes' CPU copies of the geometry are freed unless keepGeometry is set.
 class Model
 {
 public:
-	Model(char* path)
+	Model(char* path, VertexFormat format = VERTEX_FORMAT_FLOAT, bool keepGeometry = false)
+		: vertexFormat(format)
 	{
 		loadModel(path);
+		assignMaterials();
+		if (!keepGeometry)
+			for (Mesh& mesh : meshes)
+				mesh.ReleaseGeometry();
+	}
+	~Model()
+	{
+		for (unsigned int texture : acquiredTextures)
+			TextureCache::Shared().Release(texture);
+		glState.ForgetVertexArray(VAO);
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
 	}
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
 	void Draw(Shader& shader)
 	{
+		setVertexFormatUniforms(shader);
 		for (unsigned int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shader);
+		glState.BindVertexArray(0);
+	}
+	void DrawInstanced(Shader& shader, const InstanceBuffer& instances)
+	{
+		setVertexFormatUniforms(shader);
+		attachInstances(instances, 0);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].DrawInstanced(shader, instances.Count);
+		glState.BindVertexArray(0);
+	}
+	// culls every mesh against the frustum per instance, so each mesh only draws the
+	// instances in which it is visible, and splits those by the level of detail lods picks.
+	// The runs of all meshes and levels go into one buffer back to back and each run's draw
+	// attaches it at the start of its own range.
+	// With clusters enabled, instances drawn at full detail also cull their meshlets; each
+	// sees a different set, so they're drawn one by one with a multi-draw of their clusters.
+	// With order enabled, runs sharing textures are drawn together and nearest first, and
+	// the instances of a run front to back.
+	void DrawInstanced(Shader& shader, const vector<InstanceData>& instances, const Frustum& frustum,
+		const LodSelector& lods = LodSelector(), const ClusterCuller& clusters = ClusterCuller(), const DrawOrder& order = DrawOrder())
+	{
+		setVertexFormatUniforms(shader);
+		cullInstances(instances, frustum, lods, order);
+		for (const DrawRun& run : runs)
+		{
+			Mesh& mesh = meshes[run.Mesh];
+			if (!culledByCluster(run, clusters))
+			{
+				attachInstances(visibleInstances, run.First);
+				mesh.DrawInstanced(shader, run.Count, run.Lod);
+				continue;
+			}
+			for (unsigned int i = run.First; i < run.First + run.Count; i++)
+			{
+				clusters.Cull(mesh.meshlets, instances[visibleSelection[i]].Model, visibleClusters);
+				if (visibleClusters.empty())
+					continue;
+				attachInstances(visibleInstances, i);
+				mesh.DrawRanges(shader, visibleClusters.data(), visibleClusters.size());
+			}
+		}
+		glState.BindVertexArray(0);
+	}
+	// same culling as DrawInstanced, but every mesh becomes a command of one
+	// glMultiDrawElementsIndirect call (per material, see IndirectBatch.h), with the
+	// base instance selecting the mesh's visible run. Needs IndirectBatch::Supported() and a
+	// shader written for it, such as BackpackIndirect.vert/.frag.
+	// Cluster culling turns each full detail instance into a command per run of visible meshlets,
+	// and order sorts the commands as DrawInstanced sorts its draws.
+	void DrawIndirect(Shader& shader, const vector<InstanceData>& instances, const Frustum& frustum,
+		const LodSelector& lods = LodSelector(), const ClusterCuller& clusters = ClusterCuller(), const DrawOrder& order = DrawOrder())
+	{
+		setVertexFormatUniforms(shader);
+		if (!indirect)
+			indirect = std::make_unique<IndirectBatch>();
+		// commands only change with the visible sets and levels, unless the visible clusters,
+		// which follow every camera move, are part of them
+		if (cullInstances(instances, frustum, lods, order) || indirectSelection != selectionVersion || clusters.Enabled)
+		{
+			indirect->Clear();
+			for (const DrawRun& run : runs)
+			{
+				if (!culledByCluster(run, clusters))
+				{
+					indirect->Add(meshes[run.Mesh], run.Count, run.First, run.Lod);
+					continue;
+				}
+				for (unsigned int i = run.First; i < run.First + run.Count; i++)
+				{
+					clusters.Cull(meshes[run.Mesh].meshlets, instances[visibleSelection[i]].Model, visibleClusters);
+					indirect->AddRanges(meshes[run.Mesh], visibleClusters.data(), visibleClusters.size(), 1, i);
+				}
+			}
+			indirect->Upload();
+			indirectSelection = selectionVersion;
+		}
+		attachInstances(visibleInstances, 0);
+		indirect->Draw(VAO);
+		glState.BindVertexArray(0);
 	}
 private:
 	vector<Mesh> meshes;
+	unsigned int VAO = 0, VBO = 0, EBO = 0;
+	VertexFormat vertexFormat;
+	// packed positions decode to positionOffset + position * positionScale
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
+	// instances of one mesh drawn at one level of detail, a range of visibleInstances
+	struct DrawRun
+	{
+		unsigned int Mesh;
+		unsigned int Lod;
+		unsigned int First;
+		unsigned int Count;
+
+		bool operator==(const DrawRun& other) const
+		{
+			return Mesh == other.Mesh && Lod == other.Lod && First == other.First && Count == other.Count;
+		}
+	};
+	// visible instances of every mesh, grouped into runs
+	InstanceBuffer visibleInstances;
+	vector<unsigned int> visibleSelection;
+	vector<DrawRun> runs;
+	vector<DrawRun> previousRuns;
+	// scratch of the level regrouping, kept to reuse their storage
+	vector<unsigned int> lodSelection;
+	vector<unsigned int> lodInstances;
+	vector<IndexRange> visibleClusters;
+	// meshes with the same textures share a material, the state part of their draw order keys
+	vector<unsigned int> meshMaterials;
+	RenderQueue depthQueue;
+	RenderQueue runQueue;
+	vector<DrawRun> sortedRuns;
+	// bumped whenever visibleInstances or the runs change, so the indirect commands know they're stale
+	unsigned int selectionVersion = 0;
+	unsigned int indirectSelection = 0;
+	std::unique_ptr<IndirectBatch> indirect;
+	// instance attributes currently attached to the VAO
+	unsigned int attachedBuffer = 0;
+	unsigned int attachedFirst = 0;
 	string directory;
-	vector<Texture> textures_loaded;
+	// one TextureCache reference per loadTexture call, released with the model
+	vector<unsigned int> acquiredTextures;
+
+	void setVertexFormatUniforms(Shader& shader)
+	{
+		shader.setVec3("positionOffset", positionOffset);
+		shader.setVec3("positionScale", positionScale);
+		shader.setBool("octahedralNormals", vertexFormat == VERTEX_FORMAT_PACKED);
+	}
+
+	// fills visibleSelection/runs and uploads the visible instances; true if either changed
+	bool cullInstances(const vector<InstanceData>& instances, const Frustum& frustum, const LodSelector& lods, const DrawOrder& order)
+	{
+		visibleSelection.clear();
+		previousRuns.swap(runs);
+		runs.clear();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			unsigned int first = static_cast<unsigned int>(visibleSelection.size());
+			InstanceBuffer::Cull(instances, meshes[i].bounds, frustum, visibleSelection);
+			unsigned int count = static_cast<unsigned int>(visibleSelection.size()) - first;
+			if (count == 0)
+				continue;
+			if (!lods.Enabled || meshes[i].lods.size() < 2)
+			{
+				runs.push_back({ i, 0, first, count });
+				continue;
+			}
+			// regroup the mesh's visible instances by level, keeping their order within a level
+			lodSelection.resize(count);
+			for (unsigned int j = 0; j < count; j++)
+				lodSelection[j] = lods.Select(meshes[i], instances[visibleSelection[first + j]].Model);
+			lodInstances.assign(visibleSelection.begin() + first, visibleSelection.end());
+			unsigned int next = first;
+			for (unsigned int lod = 0; lod < meshes[i].lods.size(); lod++)
+			{
+				unsigned int start = next;
+				for (unsigned int j = 0; j < count; j++)
+					if (lodSelection[j] == lod)
+						visibleSelection[next++] = lodInstances[j];
+				if (next > start)
+					runs.push_back({ i, lod, start, next - start });
+			}
+		}
+		if (order.Enabled)
+			orderRuns(instances, order);
+		bool uploaded = visibleInstances.UpdateSelection(instances, visibleSelection);
+		if (!uploaded && runs == previousRuns)
+			return false;
+		selectionVersion++;
+		return true;
+	}
+
+	// sorts the instances of every run front to back, then the runs by material and nearest instance
+	void orderRuns(const vector<InstanceData>& instances, const DrawOrder& order)
+	{
+		runQueue.Clear();
+		for (unsigned int i = 0; i < runs.size(); i++)
+		{
+			const DrawRun& run = runs[i];
+			float nearest = InstanceBuffer::SortFrontToBack(instances, meshes[run.Mesh].bounds.Center(), order,
+				visibleSelection, run.First, run.Count, depthQueue);
+			runQueue.Submit(RenderQueue::Key(RENDER_PASS_OPAQUE, 0, meshMaterials[run.Mesh], nearest), i);
+		}
+		runQueue.Sort();
+		sortedRuns.resize(runs.size());
+		for (unsigned int i = 0; i < runs.size(); i++)
+			sortedRuns[i] = runs[runQueue.Item(i)];
+		runs.swap(sortedRuns);
+	}
+
+	void assignMaterials()
+	{
+		vector<unsigned int> firstMeshOfMaterial;
+		meshMaterials.resize(meshes.size());
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			unsigned int material = 0;
+			while (material < firstMeshOfMaterial.size() && !sameTextures(meshes[firstMeshOfMaterial[material]], meshes[i]))
+				material++;
+			if (material == firstMeshOfMaterial.size())
+				firstMeshOfMaterial.push_back(i);
+			meshMaterials[i] = material;
+		}
+	}
+
+	static bool sameTextures(const Mesh& a, const Mesh& b)
+	{
+		if (a.textures.size() != b.textures.size())
+			return false;
+		for (unsigned int i = 0; i < a.textures.size(); i++)
+			if (a.textures[i].id != b.textures[i].id)
+				return false;
+		return true;
+	}
+
+	// meshlets only cover the full level
+	bool culledByCluster(const DrawRun& run, const ClusterCuller& clusters) const
+	{
+		return clusters.Enabled && run.Lod == 0 && !meshes[run.Mesh].meshlets.empty();
+	}
+
+	// the instance attributes are VAO state, so they're only re-pointed when they change
+	void attachInstances(const InstanceBuffer& instances, unsigned int firstInstance)
+	{
+		if (attachedBuffer != instances.ID || attachedFirst != firstInstance)
+		{
+			instances.Attach(VAO, firstInstance);
+			attachedBuffer = instances.ID;
+			attachedFirst = firstInstance;
+		}
+	}
 
 	void loadModel(string path)
 	{
+		directory = path.substr(0, path.find_last_of('/'));
+		// models imported before come straight from the binary cache, without Assimp
+		if (loadCache(path))
+			return;
+
 		Assimp::Importer importer;
-		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+		const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
 
 		if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 		{
 			cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
 			return;
 		}
-		directory = path.substr(0, path.find_last_of('/'));
 
 		processNode(scene->mRootNode, scene);
+		// everything needed was converted, so the scene doesn't have to outlive the upload
+		importer.FreeScene();
+
+		vector<std::span<const Vertex>> vertexData;
+		vector<std::span<const unsigned int>> indexData;
+		vertexData.reserve(meshes.size());
+		indexData.reserve(meshes.size());
+		for (const Mesh& mesh : meshes)
+		{
+			vertexData.push_back(mesh.vertices);
+			indexData.push_back(mesh.indices);
+		}
+		setupBuffers(vertexData, indexData);
+
+		if (!MeshCache::Write(path, meshes))
+			cout << "ERROR::MESH_CACHE::WRITE_FAILED " << MeshCache::PathFor(path) << endl;
+	}
+
+	bool loadCache(const string& path)
+	{
+		MeshCache cache;
+		if (!cache.Open(path))
+			return false;
+
+		vector<std::span<const Vertex>> vertexData;
+		vector<std::span<const unsigned int>> indexData;
+		meshes.reserve(cache.MeshCount());
+		vertexData.reserve(cache.MeshCount());
+		indexData.reserve(cache.MeshCount());
+		for (unsigned int i = 0; i < cache.MeshCount(); i++)
+		{
+			const MeshCacheRecord& record = cache.Record(i);
+			vector<Texture> textures;
+			textures.reserve(record.TextureRefCount);
+			for (unsigned int j = 0; j < record.TextureRefCount; j++)
+				textures.push_back(loadTexture(string(cache.TexturePath(record, j)), string(cache.TextureType(record, j))));
+			vertexData.push_back(cache.Vertices(record));
+			indexData.push_back(cache.Indices(record));
+			meshes.emplace_back(vertexData.back(), indexData.back(), std::move(textures), record.MeshBounds);
+			meshes.back().lods.clear();
+			for (unsigned int lod = 0; lod < record.LodCount; lod++)
+				meshes.back().lods.push_back({ record.Lods[lod].FirstIndex, record.Lods[lod].IndexCount, record.Lods[lod].Error });
+		}
+		// uploaded straight from the mapping, which is only valid in here
+		setupBuffers(vertexData, indexData);
+		return true;
+	}
+
+	// packs the geometry of every mesh back to back into the shared buffers; vertexData[i]
+	// and indexData[i] hold meshes[i].vertexCount vertices and indexCount indices
+	void setupBuffers(const vector<std::span<const Vertex>>& vertexData, const vector<std::span<const unsigned int>>& indexData)
+	{
+		size_t totalVertices = 0, totalIndices = 0;
+		for (const Mesh& mesh : meshes)
+		{
+			totalVertices += mesh.vertexCount;
+			totalIndices += mesh.indexCount;
+		}
+
+		// one quantization range for the whole model, so every mesh decodes with the same uniforms
+		Bounds packBounds;
+		if (vertexFormat == VERTEX_FORMAT_PACKED && !meshes.empty())
+		{
+			packBounds = meshes[0].bounds;
+			for (const Mesh& mesh : meshes)
+			{
+				packBounds.Min = glm::min(packBounds.Min, mesh.bounds.Min);
+				packBounds.Max = glm::max(packBounds.Max, mesh.bounds.Max);
+			}
+			positionOffset = packBounds.Min;
+			positionScale = packBounds.Max - packBounds.Min;
+		}
+		size_t stride = VertexPacker::Stride(vertexFormat);
+
+		// imported meshes are split to fit 16 bit indices; the buffer only falls back to 32 bit
+		// for a mesh that doesn't. One type for all keeps the meshes drawable by one indirect call.
+		GLenum indexType = GL_UNSIGNED_SHORT;
+		for (const Mesh& mesh : meshes)
+			if (mesh.vertexCount > MAX_CHUNK_VERTICES)
+				indexType = GL_UNSIGNED_INT;
+		size_t indexSize = Mesh::IndexSize(indexType);
+
+		glGenVertexArrays(1, &VAO);
+		glGenBuffers(1, &VBO);
+		glGenBuffers(1, &EBO);
+
+		glState.BindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, totalVertices * stride, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndices * indexSize, NULL, GL_STATIC_DRAW);
+
+		// indices stay relative to their own mesh, the base vertex offsets them at draw time
+		vector<PackedVertex> packed;
+		vector<GLushort> shortIndices;
+		unsigned int baseVertex = 0, firstIndex = 0;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			Mesh& mesh = meshes[i];
+			const void* vertices = vertexData[i].data();
+			if (vertexFormat == VERTEX_FORMAT_PACKED)
+			{
+				packed.resize(mesh.vertexCount);
+				for (unsigned int v = 0; v < mesh.vertexCount; v++)
+					packed[v] = VertexPacker::Pack(vertexData[i][v], packBounds);
+				vertices = packed.data();
+			}
+			const void* indices = indexData[i].data();
+			if (indexType == GL_UNSIGNED_SHORT)
+			{
+				shortIndices.assign(indexData[i].begin(), indexData[i].end());
+				indices = shortIndices.data();
+			}
+			glBufferSubData(GL_ARRAY_BUFFER, baseVertex * stride, mesh.vertexCount * stride, vertices);
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex * indexSize, mesh.indexCount * indexSize, indices);
+			mesh.SetBufferRange(VAO, baseVertex, firstIndex, indexType);
+			// cheap enough to rebuild on every load rather than cache; lods[0] starts the range
+			mesh.meshlets = MeshletBuilder::Build(vertexData[i].data(), mesh.vertexCount, indexData[i].data(), mesh.lods[0].IndexCount);
+			baseVertex += mesh.vertexCount;
+			firstIndex += mesh.indexCount;
+		}
+
+		VertexPacker::SetupAttributes(vertexFormat);
+		glState.BindVertexArray(0);
 	}
 
+	// converts every mesh of the scene on the shared pool at once; only the texture
+	// creation afterwards runs here, on the context thread, in scene order
 	void processNode(aiNode* node, const aiScene* scene)
 	{
-		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+		vector<const aiMesh*> sceneMeshes;
+		collectMeshes(node, scene, sceneMeshes);
+
+		vector<std::future<MeshData>> converted;
+		converted.reserve(sceneMeshes.size());
+		for (const aiMesh* mesh : sceneMeshes)
+			converted.push_back(ThreadPool::Shared().Submit([mesh, scene] { return processMesh(mesh, scene); }));
+
+		// a scene mesh may come back in several parts, so all results are in before reserving
+		vector<MeshData> results;
+		results.reserve(converted.size());
+		size_t partCount = 0;
+		for (std::future<MeshData>& result : converted)
 		{
-			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-			meshes.push_back(processMesh(mesh, scene));
+			results.push_back(result.get());
+			partCount += results.back().parts.size();
 		}
-		
-		for (unsigned int i = 0; i < node->mNumChildren; i++)
+		meshes.reserve(meshes.size() + partCount);
+
+		for (unsigned int i = 0; i < results.size(); i++)
 		{
-			processNode(node->mChildren[i], scene);
+			MeshData& data = results[i];
+			const MeshOptimizerReport& report = data.optimization;
+			cout << "Mesh " << i << ": " << report.VerticesBefore << " -> " << report.VerticesAfter << " vertices, ACMR "
+				<< report.Before.ACMR << " -> " << report.After.ACMR << ", ATVR " << report.Before.ATVR << " -> " << report.After.ATVR;
+			if (data.parts.size() > 1)
+				cout << ", split into " << data.parts.size() << " parts";
+			if (!data.parts.empty() && data.parts[0].Lods.size() > 1)
+				cout << ", " << data.parts[0].Lods.size() - 1 << " LODs down to " << data.parts[0].Lods.back().IndexCount / 3 << " triangles";
+			cout << endl;
+			vector<Texture> textures;
+			textures.reserve(data.textures.size());
+			for (const TextureRef& ref : data.textures)
+				textures.push_back(loadTexture(ref.path, ref.type));
+			for (MeshChunk& part : data.parts)
+			{
+				meshes.emplace_back(std::move(part.Vertices), std::move(part.Indices), textures);
+				meshes.back().lods = std::move(part.Lods);
+			}
 		}
 	}
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene)
+
+	static void collectMeshes(const aiNode* node, const aiScene* scene, vector<const aiMesh*>& sceneMeshes)
+	{
+		for (unsigned int i = 0; i < node->mNumMeshes; i++)
+			sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+
+		for (unsigned int i = 0; i < node->mNumChildren; i++)
+			collectMeshes(node->mChildren[i], scene, sceneMeshes);
+	}
+
+	// runs on a worker thread: reads the scene only and touches no GL or Model state
+	static MeshData processMesh(const aiMesh* mesh, const aiScene* scene)
 	{
+		MeshData data;
 		vector<Vertex> vertices;
 		vector<unsigned int> indices;
-		vector<Texture> textures;
 
+		vertices.resize(mesh->mNumVertices);
 		for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 		{
-			Vertex vertex;
-			glm::vec3 vector;
-			vector.x = mesh->mVertices[i].x;
-			vector.y = mesh->mVertices[i].y;
-			vector.z = mesh->mVertices[i].z;
-			vertex.Position = vector;
+			Vertex& vertex = vertices[i];
+			vertex.Position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
 
-			vector.x = mesh->mNormals[i].x;
-			vector.y = mesh->mNormals[i].y;
-			vector.z = mesh->mNormals[i].z;
-			vertex.Normal = vector;
+			if (mesh->mNormals)
+				vertex.Normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+			else
+				vertex.Normal = glm::vec3(0.0f, 0.0f, 0.0f);
 
 			if (mesh->mTextureCoords[0])
-			{
-				glm::vec2 vec;
-				vec.x = mesh->mTextureCoords[0][i].x;
-				vec.y = mesh->mTextureCoords[0][i].y;
-				vertex.TexCoords = vec;
-			}
+				vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
 			else
 				vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-			vertices.push_back(vertex);
 		}
-		
+
+		// aiProcess_Triangulate leaves point and line faces alone; the optimizer needs a pure
+		// triangle list, so they're skipped
+		indices.reserve(mesh->mNumFaces * 3);
 		for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 		{
-			aiFace face = mesh->mFaces[i];
-			for (unsigned int j = 0; j < face.mNumIndices; j++)
-				indices.push_back(face.mIndices[j]);
+			const aiFace& face = mesh->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;
+			indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
 		}
-		
-		if (mesh->mMaterialIndex >= 0)
+		// vertex and face order as they end up in the cache, see MeshOptimizer.h
+		data.optimization = MeshOptimizer::Optimize(vertices, indices);
+		data.parts = MeshOptimizer::SplitByVertexCount(std::move(vertices), std::move(indices));
+		// the coarser levels index the part's own vertices, so they're built after the split
+		for (MeshChunk& part : data.parts)
+			MeshSimplifier::BuildLods(part.Vertices, part.Indices, part.Lods);
+
+		if (mesh->mMaterialIndex < scene->mNumMaterials)
 		{
 			aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-			vector<Texture> diffuseMaps = loadMaterialTextures(material,
-				aiTextureType_DIFFUSE, "texture_diffuse");
-			textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-			vector<Texture> specularMaps = loadMaterialTextures(material,
-				aiTextureType_SPECULAR, "texture_specular");
-			textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+			collectTextureRefs(material, aiTextureType_DIFFUSE, "texture_diffuse", data.textures);
+			collectTextureRefs(material, aiTextureType_SPECULAR, "texture_specular", data.textures);
 		}
 
-		return Mesh(vertices, indices, textures);
+		return data;
 	}
 
-	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
+	static void collectTextureRefs(aiMaterial* mat, aiTextureType type, const string& typeName, vector<TextureRef>& refs)
 	{
-		vector<Texture> textures;
 		for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
 		{
 			aiString str;
 			mat->GetTexture(type, i, &str);
-			bool skip = false;
-			for (unsigned int j = 0; j < textures_loaded.size(); j++)
-			{
-				if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-				{
-					textures.push_back(textures_loaded[j]);
-					skip = true;
-					break;
-				}
-			}
-			if (!skip)
-			{
-				Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), directory);
-				texture.type = typeName;
-				texture.path = str.C_Str();
-				textures.push_back(texture);
-				textures_loaded.push_back(texture);
-			}
+			refs.push_back({ typeName, str.C_Str() });
 		}
-		return textures;
+	}
+
+	// repeated paths, within this model or across models, resolve to one texture in TextureCache
+	Texture loadTexture(const string& path, const string& typeName)
+	{
+		Texture texture;
+		texture.id = TextureFromFile(path.c_str(), directory);
+		texture.type = typeName;
+		texture.path = path;
+		acquiredTextures.push_back(texture.id);
+		return texture;
 	}
 
 };
@@ -146,37 +590,7 @@ unsigned int TextureFromFile(const char* path, const string& directory, bool gam
 	string filename = string(path);
 	filename = directory + '/' + filename;
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
\ No newline at end of file
+	// decoded in the background, the returned texture is a placeholder until then; the caller
+	// holds a TextureCache reference to it
+	return TextureCache::Shared().Acquire(filename);
+}
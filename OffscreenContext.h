@@ -0,0 +1,181 @@
+#pragma once
+
+// Windowless OpenGL context used by the headless build. Rendering goes into a
+// framebuffer object, so nothing here needs a display server or a GPU: Mesa's
+// llvmpipe behind a surfaceless EGL display (or OSMesa) is enough.
+
+#include <glad/glad.h>
+
+#ifdef LEARNOPENGL_OSMESA
+#include <GL/osmesa.h>
+#else
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <iostream>
+#include <vector>
+
+class OffscreenContext
+{
+public:
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+
+    ~OffscreenContext()
+    {
+        Destroy();
+    }
+
+    // creates a core profile context and makes it current; call before gladLoadGLLoader
+    bool Create(unsigned int width, unsigned int height, int major = 3, int minor = 3)
+    {
+        Width = width;
+        Height = height;
+#ifdef LEARNOPENGL_OSMESA
+        const int attribs[] = {
+            OSMESA_FORMAT, OSMESA_RGBA,
+            OSMESA_DEPTH_BITS, 24,
+            OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, major,
+            OSMESA_CONTEXT_MINOR_VERSION, minor,
+            0
+        };
+        context = OSMesaCreateContextAttribs(attribs, NULL);
+        if (context == NULL)
+        {
+            std::cout << "ERROR::OFFSCREEN::OSMESA_CONTEXT_CREATION_FAILED" << std::endl;
+            return false;
+        }
+        buffer.resize(width * height * 4);
+        if (!OSMesaMakeCurrent(context, buffer.data(), GL_UNSIGNED_BYTE, width, height))
+        {
+            std::cout << "ERROR::OFFSCREEN::OSMESA_MAKE_CURRENT_FAILED" << std::endl;
+            return false;
+        }
+        return true;
+#else
+        // prefer Mesa's surfaceless platform, it never touches X11/Wayland or /dev/dri
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint eglMajor, eglMinor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor))
+        {
+            std::cout << "ERROR::OFFSCREEN::EGL_INITIALIZE_FAILED" << std::endl;
+            return false;
+        }
+
+        // no surface bits requested, we only ever render into framebuffer objects
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, 0,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+        {
+            std::cout << "ERROR::OFFSCREEN::EGL_NO_MATCHING_CONFIG" << std::endl;
+            return false;
+        }
+
+        eglBindAPI(EGL_OPENGL_API);
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT)
+        {
+            std::cout << "ERROR::OFFSCREEN::EGL_CONTEXT_CREATION_FAILED" << std::endl;
+            return false;
+        }
+        if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::OFFSCREEN::EGL_MAKE_CURRENT_FAILED" << std::endl;
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    static void* GetProcAddress(const char* name)
+    {
+#ifdef LEARNOPENGL_OSMESA
+        return (void*)OSMesaGetProcAddress(name);
+#else
+        return (void*)eglGetProcAddress(name);
+#endif
+    }
+
+    // creates the color/depth render target; needs a loaded GL, so call after gladLoadGLLoader
+    void CreateFramebuffer()
+    {
+        glGenFramebuffers(1, &FBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+        glGenRenderbuffers(1, &colorRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+
+        glGenRenderbuffers(1, &depthRBO);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRBO);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, Width, Height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OFFSCREEN::FRAMEBUFFER_INCOMPLETE" << std::endl;
+    }
+
+    // stand-in for glfwSwapBuffers: waits for the frame so timings include the GPU work
+    void SwapBuffers()
+    {
+        glFinish();
+    }
+
+    void Destroy()
+    {
+        if (FBO)
+        {
+            glDeleteFramebuffers(1, &FBO);
+            glDeleteRenderbuffers(1, &colorRBO);
+            glDeleteRenderbuffers(1, &depthRBO);
+            FBO = colorRBO = depthRBO = 0;
+        }
+#ifdef LEARNOPENGL_OSMESA
+        if (context != NULL)
+        {
+            OSMesaDestroyContext(context);
+            context = NULL;
+        }
+#else
+        if (display != EGL_NO_DISPLAY)
+        {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            eglTerminate(display);
+            context = EGL_NO_CONTEXT;
+            display = EGL_NO_DISPLAY;
+        }
+#endif
+    }
+
+private:
+    unsigned int FBO = 0, colorRBO = 0, depthRBO = 0;
+#ifdef LEARNOPENGL_OSMESA
+    OSMesaContext context = NULL;
+    std::vector<unsigned char> buffer;
+#else
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+#endif
+};
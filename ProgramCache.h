@@ -0,0 +1,143 @@
+#pragma once
+
+// Linked program binaries kept on disk, so a warm start skips compiling and linking. A
+// program is stored as "<vertex shader>.<key>.progbin", the key hashing both sources, the
+// defines they were built with and the driver's vendor, renderer and version strings. A
+// driver update or a source edit thus changes the key, and a binary the driver rejects
+// anyway (glProgramBinary leaves the program unlinked) is recompiled and written again.
+//
+// Layout (native endianness): ProgramCacheHeader, then Length bytes of the binary.
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// bump whenever the layout changes
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader
+{
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Key;
+    uint32_t Format;
+    uint32_t Length;
+};
+
+class ProgramCache
+{
+public:
+    // off for --no-program-cache, so cold start compile times can be measured
+    static inline bool Enabled = true;
+
+    static bool Supported()
+    {
+        return Enabled && glExtensions.ProgramBinary != nullptr;
+    }
+
+    // needs a current context for the driver strings
+    static uint64_t Key(std::string_view vertexSource, std::string_view fragmentSource, std::string_view defines)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        // the separators keep "ab" + "c" and "a" + "bc" apart
+        for (std::string_view part : { vertexSource, fragmentSource, defines, glString(GL_VENDOR), glString(GL_RENDERER), glString(GL_VERSION) })
+        {
+            for (char c : part)
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            hash = (hash ^ 0xFFu) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static std::string PathFor(const std::string& vertexPath, uint64_t key)
+    {
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+        return vertexPath + "." + hex + ".progbin";
+    }
+
+    // loads the cached binary into program; true if it's now linked
+    static bool Load(unsigned int program, const std::string& vertexPath, uint64_t key)
+    {
+        if (!Supported())
+            return false;
+        std::ifstream in(PathFor(vertexPath, key), std::ios::binary);
+        if (!in)
+            return false;
+        ProgramCacheHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::string_view(header.Magic, 4) != "LOPB"
+            || header.Version != PROGRAM_CACHE_VERSION || header.Key != key || header.Length == 0)
+            return false;
+        std::vector<char> binary(header.Length);
+        if (!in.read(binary.data(), binary.size()))
+            return false;
+
+        glExtensions.ProgramBinary(program, header.Format, binary.data(), static_cast<GLsizei>(binary.size()));
+        int success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success != 0;
+    }
+
+    // call before glLinkProgram, so the driver keeps the binary around for Save
+    static void PrepareForSave(unsigned int program)
+    {
+        if (Supported())
+            glExtensions.ProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // writes the binary of a linked program
+    static bool Save(unsigned int program, const std::string& vertexPath, uint64_t key)
+    {
+        if (!Supported())
+            return false;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return false;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glExtensions.GetProgramBinary(program, length, &written, &format, binary.data());
+        if (written <= 0)
+            return false;
+
+        ProgramCacheHeader header = {};
+        header.Magic[0] = 'L'; header.Magic[1] = 'O'; header.Magic[2] = 'P'; header.Magic[3] = 'B';
+        header.Version = PROGRAM_CACHE_VERSION;
+        header.Key = key;
+        header.Format = format;
+        header.Length = static_cast<uint32_t>(written);
+
+        // written under a temporary name so an interrupted write never leaves a truncated binary behind
+        std::string cachePath = PathFor(vertexPath, key);
+        std::string tempPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(binary.data(), written);
+            if (!out)
+                return false;
+        }
+        std::error_code error;
+        std::filesystem::rename(tempPath, cachePath, error);
+        return !error;
+    }
+
+private:
+    static std::string_view glString(GLenum name)
+    {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        return value ? std::string_view(value) : std::string_view();
+    }
+};
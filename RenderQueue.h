@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glm.hpp>
+
+#include "Camera.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+enum RenderPass {
+    RENDER_PASS_OPAQUE = 0,
+    RENDER_PASS_TRANSPARENT = 1
+};
+
+// Where draw depth is measured from. A default constructed order is disabled and leaves
+// draws in submission order.
+struct DrawOrder
+{
+    bool Enabled = false;
+    glm::vec3 ViewPosition = glm::vec3(0.0f);
+
+    static DrawOrder FromCamera(const Camera& camera)
+    {
+        DrawOrder order;
+        order.Enabled = true;
+        order.ViewPosition = camera.Position;
+        return order;
+    }
+};
+
+// Draws submitted as a 64 bit sort key and an item (whatever index the caller resolves the
+// draw from), radix sorted into execution order. Programs are keyed by Shader::SortIndex, not
+// their GL name, so they fit the field. Key layout, most significant bits first:
+//   opaque:      pass (2) | program (10) | material (20) | depth (32)  front to back
+//   transparent: pass (2) | depth (32, inverted) | program (10) | material (20)  back to front
+// Opaque draws are grouped by state and only then ordered by depth, so program and texture
+// changes stay minimal while nearer draws of a group still fill the depth buffer first;
+// transparent draws have to blend in depth order, whatever it costs in state changes.
+class RenderQueue
+{
+public:
+    static const unsigned int MAX_PROGRAMS = 1u << 10;
+    static const unsigned int MAX_MATERIALS = 1u << 20;
+
+    static uint64_t Key(RenderPass pass, unsigned int program, unsigned int material, float depth)
+    {
+        assert(program < MAX_PROGRAMS && material < MAX_MATERIALS);
+        uint64_t state = (static_cast<uint64_t>(program) << 20) | material;
+        uint64_t key = static_cast<uint64_t>(pass) << 62;
+        if (pass == RENDER_PASS_TRANSPARENT)
+            return key | (static_cast<uint64_t>(~DepthBits(depth)) << 30) | state;
+        return key | (state << 32) | DepthBits(depth);
+    }
+
+    // non-negative floats order like their bit patterns
+    static uint32_t DepthBits(float depth)
+    {
+        depth = std::max(depth, 0.0f);
+        uint32_t bits;
+        std::memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+
+    void Clear()
+    {
+        entries.clear();
+    }
+
+    void Submit(uint64_t key, uint32_t item)
+    {
+        entries.push_back({ key, item });
+    }
+
+    // stable least significant digit radix sort, a byte per pass; one counting pass finds
+    // the bytes every key shares, whose passes wouldn't move anything and are skipped
+    void Sort()
+    {
+        size_t count = entries.size();
+        if (count < 2)
+            return;
+        uint32_t histograms[8][256] = {};
+        for (const Entry& entry : entries)
+        {
+            for (unsigned int digit = 0; digit < 8; ++digit)
+                histograms[digit][(entry.Key >> (digit * 8)) & 0xFF]++;
+        }
+
+        scratch.resize(count);
+        for (unsigned int digit = 0; digit < 8; ++digit)
+        {
+            uint32_t* histogram = histograms[digit];
+            if (histogram[(entries[0].Key >> (digit * 8)) & 0xFF] == count)
+                continue;
+            uint32_t offset = 0;
+            for (unsigned int bucket = 0; bucket < 256; ++bucket)
+            {
+                uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+            for (const Entry& entry : entries)
+                scratch[histogram[(entry.Key >> (digit * 8)) & 0xFF]++] = entry;
+            entries.swap(scratch);
+        }
+    }
+
+    size_t Size() const
+    {
+        return entries.size();
+    }
+
+    // the item at position i of the sorted order
+    uint32_t Item(size_t i) const
+    {
+        return entries[i].Item;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t Key;
+        uint32_t Item;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+};
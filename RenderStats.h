@@ -0,0 +1,26 @@
+#pragma once
+
+// Per-frame counters filled in by the draw sites, reset by the main loop every frame.
+struct RenderStats
+{
+    unsigned int DrawCalls = 0;
+    // objects (instances, or mesh instances for models) that passed and failed frustum culling
+    unsigned int Submitted = 0;
+    unsigned int Culled = 0;
+    // triangles submitted, after level of detail selection and cluster culling
+    unsigned int Triangles = 0;
+    // meshlets of visible mesh instances that passed and failed cluster culling
+    unsigned int ClustersSubmitted = 0;
+    unsigned int ClustersCulled = 0;
+    // program, vertex array, texture and uniform calls that reached GL, and those GLState and
+    // Shader dropped because they would have set the current value again
+    unsigned int StateCalls = 0;
+    unsigned int StateCallsFiltered = 0;
+
+    void Reset()
+    {
+        *this = RenderStats();
+    }
+};
+
+inline RenderStats renderStats;
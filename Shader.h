@@ -5,17 +5,43 @@
 #include <glm.hpp>
 #include <gtc/type_ptr.hpp>
 
+#include "UniformBuffer.h"
+#include "GLExtensions.h"
+#include "GLState.h"
+#include "RenderStats.h"
+#include "ProgramCache.h"
+
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
+#include <vector>
+
+// lets the location table be searched with a string_view, so lookups never allocate
+struct UniformNameHash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>()(name); }
+};
 
 class Shader
 {
 public:
 	unsigned int ID;
+    // dense number of the program, counting from 1 in creation order; RenderQueue keys use it
+    // because GL names can be anything. 0 is left to draws sorted without a program
+    unsigned int SortIndex = ++programCount;
+    // leave compiling and linking to the driver's pace: the constructor only submits the work
+    // and the status is checked when the program is first used, so the programs created at
+    // startup build side by side while models and textures load
+    static inline bool AsyncCompile = false;
 
-    Shader(const char* vertexPath, const char* fragmentPath)
+    // each entry of defines ("NAME" or "NAME VALUE") becomes a #define after the #version line of both stages
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {})
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -45,80 +71,289 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        std::string defineBlock;
+        for (const std::string& define : defines)
+            defineBlock += "#define " + define + "\n";
+        vertexCode = injectDefines(vertexCode, defineBlock);
+        fragmentCode = injectDefines(fragmentCode, defineBlock);
+        // 2. a program linked on an earlier run comes straight from the binary cache
+        ID = glCreateProgram();
+        cacheKey = ProgramCache::Key(vertexCode, fragmentCode, defineBlock);
+        cacheVertexPath = vertexPath;
+        if (ProgramCache::Load(ID, vertexPath, cacheKey))
+        {
+            finish();
+            return;
+        }
+        // a rejected binary may leave the program in any state, start over
+        glDeleteProgram(ID);
+        ID = glCreateProgram();
+
+        // 3. otherwise compile shaders; the driver works on them while we carry on, nothing
+        // below waits for it until finish() asks for the status
         const char* vShaderCode = vertexCode.c_str();
         const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        int success;
-        char infoLog[512];
-
-        // vertex Shader
         vertex = glCreateShader(GL_VERTEX_SHADER);
         glShaderSource(vertex, 1, &vShaderCode, NULL);
         glCompileShader(vertex);
-        // print compile errors if any
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        };
-
         fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1 ,&fShaderCode, NULL);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
         glCompileShader(fragment);
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-        if (!success)
-        {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-        };
 
-        ID = glCreateProgram();
         glAttachShader(ID, vertex);
         glAttachShader(ID, fragment);
+        ProgramCache::PrepareForSave(ID);
         glLinkProgram(ID);
-        // print linking errors if any
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
-        if (!success)
-        {
-            glGetProgramInfoLog(ID, 512, NULL, infoLog);
-            std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-        }
 
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        if (!AsyncCompile)
+            finish();
+    }
+
+    // false while the driver is still compiling or linking in the background; never blocks.
+    // Without KHR_parallel_shader_compile there's no way to ask, so a pending program reports
+    // ready and its first use waits for it.
+    bool IsReady() const
+    {
+        if (finished || !glExtensions.ParallelShaderCompile)
+            return true;
+        int complete = GL_TRUE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete != GL_FALSE;
+    }
+
+    // location of an active uniform, or -1 (which glUniform* ignores) if the program doesn't use it.
+    // Resolve locations once outside the render loop and pass them to the location-based setters.
+    int getUniformLocation(std::string_view name) const
+    {
+        finish();
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+
+    void use()
+    {
+        finish();
+        glState.UseProgram(ID);
+    }
+    void setBool(std::string_view name, bool value) const
+    {
+        setBool(getUniformLocation(name), value);
+    }
+    void setInt(std::string_view name, int value) const
+    {
+        setInt(getUniformLocation(name), value);
+    }
+    void setFloat(std::string_view name, float value) const
+    {
+        setFloat(getUniformLocation(name), value);
+    }
+    void setMat4(std::string_view name, glm::mat4 value) const
+    {
+        setMat4(getUniformLocation(name), value);
+    }
+    void setMat3(std::string_view name, glm::mat4 value) const
+    {
+        setMat3(getUniformLocation(name), value);
+    }
+    void setVec3(std::string_view name, float x, float y, float z) const
+    {
+        setVec3(getUniformLocation(name), x, y, z);
+    }
+    void setVec3(std::string_view name, glm::vec3 value) const
+    {
+        setVec3(getUniformLocation(name), value);
     }
 
-    void use() { glUseProgram(ID); }
-    void setBool(const std::string& name, bool value) const
+    // Like glUniform*, these apply to the program in use, which has to be this one. A value
+    // the program already holds isn't sent again.
+    void setBool(int location, bool value) const
+    {
+        setInt(location, (int)value);
+    }
+    void setInt(int location, int value) const
+    {
+        if (uniformChanged(location, &value, sizeof(value)))
+            glUniform1i(location, value);
+    }
+    void setFloat(int location, float value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        if (uniformChanged(location, &value, sizeof(value)))
+            glUniform1f(location, value);
     }
-    void setInt(const std::string& name, int value) const
+    void setMat4(int location, const glm::mat4& value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        if (uniformChanged(location, glm::value_ptr(value), 16 * sizeof(float)))
+            glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
-    void setFloat(const std::string& name, float value) const
+    void setMat3(int location, const glm::mat4& value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        if (uniformChanged(location, glm::value_ptr(value), 9 * sizeof(float)))
+            glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
-    void setMat4(const std::string& name, glm::mat4 value) const
+    void setVec3(int location, float x, float y, float z) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        const float value[3] = { x, y, z };
+        if (uniformChanged(location, value, sizeof(value)))
+            glUniform3f(location, x, y, z);
+    }
+    void setVec3(int location, const glm::vec3& value) const
+    {
+        setVec3(location, value.x, value.y, value.z);
+    }
+
+private:
+    static inline unsigned int programCount = 0;
+    // the link result is only looked at on first use, which may be from a const setter
+    mutable std::unordered_map<std::string, int, UniformNameHash, std::equal_to<>> uniformLocations;
+    // last value sent to each location, the bytes of at most a mat4
+    struct UniformValue
+    {
+        size_t Size = 0;
+        unsigned char Data[16 * sizeof(float)];
+    };
+    mutable std::vector<UniformValue> uniformValues;
+    mutable bool finished = false;
+    // stages of a program that still has to be checked, 0 once it came from the cache or was checked
+    mutable unsigned int vertex = 0;
+    mutable unsigned int fragment = 0;
+    uint64_t cacheKey = 0;
+    std::string cacheVertexPath;
+
+    // waits for the compile and link submitted by the constructor, reports their errors,
+    // stores the binary and reflects the program; does nothing after the first call
+    void finish() const
+    {
+        if (finished)
+            return;
+        finished = true;
+
+        if (vertex)
+        {
+            int success;
+            char infoLog[512];
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+            if (!success)
+            {
+                // the stage logs say more than the link log when compiling was what failed
+                glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(vertex, 512, NULL, infoLog);
+                    std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+                }
+                glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+                if (!success)
+                {
+                    glGetShaderInfoLog(fragment, 512, NULL, infoLog);
+                    std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+                }
+                glGetProgramInfoLog(ID, 512, NULL, infoLog);
+                std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+            }
+            else if (ProgramCache::Supported() && !ProgramCache::Save(ID, cacheVertexPath, cacheKey))
+                std::cout << "ERROR::SHADER::PROGRAM_CACHE_WRITE_FAILED " << ProgramCache::PathFor(cacheVertexPath, cacheKey) << std::endl;
+
+            // delete the shaders as they're linked into our program now and no longer necessary
+            glDeleteShader(vertex);
+            glDeleteShader(fragment);
+            vertex = 0;
+            fragment = 0;
+        }
+
+        reflectUniforms();
+        bindUniformBlocks();
     }
-    void setMat3(const std::string& name, glm::mat4 value) const
+
+    // false if location already holds value; otherwise remembers it for next time
+    bool uniformChanged(int location, const void* value, size_t size) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        // GL ignores -1, so there's nothing to send
+        if (location < 0)
+            return false;
+        if (location < (int)uniformValues.size())
+        {
+            UniformValue& cached = uniformValues[location];
+            if (cached.Size == size && std::memcmp(cached.Data, value, size) == 0)
+            {
+                renderStats.StateCallsFiltered++;
+                return false;
+            }
+            cached.Size = size;
+            std::memcpy(cached.Data, value, size);
+        }
+        renderStats.StateCalls++;
+        return true;
     }
-    void setVec3(const std::string& name, float x, float y, float z) const
+
+    // #version has to stay the first statement, so the defines go right after it
+    static std::string injectDefines(const std::string& source, const std::string& defineBlock)
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+        if (defineBlock.empty())
+            return source;
+        size_t version = source.find("#version");
+        if (version == std::string::npos)
+            return defineBlock + source;
+        size_t lineEnd = source.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return source + "\n" + defineBlock;
+        return source.substr(0, lineEnd + 1) + defineBlock + source.substr(lineEnd + 1);
     }
-    void setVec3(const std::string& name, glm::vec3 value) const
+
+    // builds the name -> location table from the linked program, the only place glGetUniformLocation is called
+    void reflectUniforms() const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), value.x, value.y, value.z);
+        uniformLocations.clear();
+        uniformValues.clear();
+        int count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (int i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            int location = glGetUniformLocation(ID, name.c_str());
+            // members of uniform blocks have no location
+            if (location < 0)
+                continue;
+            uniformLocations[name] = location;
+
+            // arrays of basic types are reported once as "name[0]": register "name" and every element
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations[base] = location;
+                for (int element = 1; element < size; ++element)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+                }
+            }
+        }
+
+        int maxLocation = -1;
+        for (const auto& entry : uniformLocations)
+            maxLocation = std::max(maxLocation, entry.second);
+        uniformValues.resize(maxLocation + 1);
     }
 
+    // attaches the shared Frame/Lights blocks to their binding points, see UniformBuffer.h
+    void bindUniformBlocks() const
+    {
+        int count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        std::vector<char> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (int i = 0; i < count; ++i)
+        {
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(ID, i, (GLsizei)nameBuffer.size(), &length, nameBuffer.data());
+            int binding = uniformBlockBinding(std::string_view(nameBuffer.data(), length));
+            if (binding >= 0)
+                glUniformBlockBinding(ID, i, binding);
+        }
+    }
 };
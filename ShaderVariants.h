@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Shader.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Permutations of one vertex/fragment pair, compiled on first use and kept for the rest of
+// the run. A variant is identified by its define set, so features a draw doesn't need are
+// removed by the preprocessor instead of branched over per fragment. Pass the defines in
+// the same order every time, a reordered set compiles again as a separate variant.
+class ShaderVariants
+{
+public:
+    // runs once on every variant, when Get first hands it out, e.g. to point its samplers at texture units
+    std::function<void(Shader&)> OnCompile;
+
+    ShaderVariants(std::string vertexPath, std::string fragmentPath)
+        : vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath))
+    {
+    }
+
+    // starts compiling a variant that will be needed soon, without waiting for it (see Shader::AsyncCompile);
+    // once the returned program IsReady, Get hands it out without blocking
+    const Shader& Prepare(const std::vector<std::string>& defines)
+    {
+        return *find(defines).Program;
+    }
+
+    Shader& Get(const std::vector<std::string>& defines)
+    {
+        Variant& variant = find(defines);
+        if (!variant.Configured)
+        {
+            variant.Configured = true;
+            if (OnCompile)
+            {
+                variant.Program->use();
+                OnCompile(*variant.Program);
+            }
+        }
+        return *variant.Program;
+    }
+
+    size_t Size() const
+    {
+        return variants.size();
+    }
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> Program;
+        bool Configured = false;
+    };
+
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::unordered_map<std::string, Variant> variants;
+
+    Variant& find(const std::vector<std::string>& defines)
+    {
+        std::string key;
+        for (const std::string& define : defines)
+            key += define + "\n";
+        auto found = variants.find(key);
+        if (found != variants.end())
+            return found->second;
+        Variant& variant = variants[std::move(key)];
+        variant.Program = std::make_unique<Shader>(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        return variant;
+    }
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+#include "GLState.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Process wide texture table, so an image referenced by several models (or several times by
+// one) is decoded and uploaded once. Textures are keyed by their normalized absolute path
+// and, with HashContents set, also by a hash of the file, which catches copies of one image
+// under different names. Every Acquire needs a Release; textures nobody holds stay resident
+// until Evict, so a model that is reloaded right away finds them still there.
+class TextureCache
+{
+public:
+    // hash file contents on a path miss; costs a read of the file on the calling thread
+    bool HashContents = false;
+    // lookups answered from the table, and textures that had to be loaded
+    unsigned int Hits = 0;
+    unsigned int Misses = 0;
+
+    static TextureCache& Shared()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // the texture for path, loaded through TextureLoader on first use; holds a reference
+    unsigned int Acquire(const std::string& path, bool flipVertically = true)
+    {
+        std::string key = normalize(path, flipVertically);
+        auto found = byPath.find(key);
+        if (found != byPath.end())
+        {
+            ++Hits;
+            records[found->second].RefCount++;
+            return found->second;
+        }
+
+        uint64_t contentHash = 0;
+        if (HashContents && hashFile(path, contentHash))
+        {
+            // the flip is part of the content key, a flipped copy is a different texture
+            contentHash ^= flipVertically ? 0x9E3779B97F4A7C15ull : 0;
+            auto same = byContent.find(contentHash);
+            if (same != byContent.end())
+            {
+                ++Hits;
+                Record& record = records[same->second];
+                record.RefCount++;
+                record.Keys.push_back(key);
+                byPath.emplace(key, same->second);
+                return same->second;
+            }
+        }
+
+        ++Misses;
+        unsigned int texture = TextureLoader::Shared().Load(path, flipVertically);
+        Record& record = records[texture];
+        record.RefCount = 1;
+        record.Keys.push_back(key);
+        record.ContentHash = contentHash;
+        byPath.emplace(key, texture);
+        if (contentHash)
+            byContent.emplace(contentHash, texture);
+        return texture;
+    }
+
+    void Release(unsigned int texture)
+    {
+        auto found = records.find(texture);
+        if (found == records.end() || found->second.RefCount == 0)
+        {
+            std::cout << "ERROR::TEXTURE_CACHE::RELEASE_UNHELD " << texture << std::endl;
+            return;
+        }
+        found->second.RefCount--;
+    }
+
+    // deletes the textures no one holds, except those still streaming in; returns how many
+    unsigned int Evict()
+    {
+        unsigned int evicted = 0;
+        for (auto it = records.begin(); it != records.end(); )
+        {
+            if (it->second.RefCount > 0 || TextureLoader::Shared().IsPending(it->first))
+            {
+                ++it;
+                continue;
+            }
+            for (const std::string& key : it->second.Keys)
+                byPath.erase(key);
+            if (it->second.ContentHash)
+                byContent.erase(it->second.ContentHash);
+            glState.ForgetTexture(it->first);
+            glDeleteTextures(1, &it->first);
+            it = records.erase(it);
+            ++evicted;
+        }
+        return evicted;
+    }
+
+    size_t Size() const
+    {
+        return records.size();
+    }
+
+private:
+    struct Record
+    {
+        unsigned int RefCount = 0;
+        // every normalized path that resolved to the texture
+        std::vector<std::string> Keys;
+        uint64_t ContentHash = 0;
+    };
+
+    std::unordered_map<std::string, unsigned int> byPath;
+    std::unordered_map<uint64_t, unsigned int> byContent;
+    std::unordered_map<unsigned int, Record> records;
+
+    TextureCache() = default;
+    // like TextureLoader, GL objects are left to the context
+
+    // "a/./b/../c.png" and "a/c.png" name the same file; the flip becomes part of the key
+    static std::string normalize(const std::string& path, bool flipVertically)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        std::string key = (error ? std::filesystem::path(path) : absolute).lexically_normal().generic_string();
+        return key + (flipVertically ? "|flip" : "");
+    }
+
+    // FNV-1a over the whole file
+    static bool hashFile(const std::string& path, uint64_t& hash)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return false;
+        hash = 14695981039346656037ull;
+        std::vector<char> buffer(64 * 1024);
+        while (in)
+        {
+            in.read(buffer.data(), buffer.size());
+            std::streamsize read = in.gcount();
+            for (std::streamsize i = 0; i < read; ++i)
+            {
+                hash ^= static_cast<unsigned char>(buffer[i]);
+                hash *= 1099511628211ull;
+            }
+        }
+        // 0 marks "not hashed"
+        if (hash == 0)
+            hash = 1;
+        return true;
+    }
+};
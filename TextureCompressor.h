@@ -0,0 +1,454 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "GLExtensions.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block compressed formats the driver can sample, queried once on the GL thread.
+// RGTC (BC4/BC5) is core since 3.0 and always available.
+enum Compressed_Format_Support {
+    SUPPORT_S3TC = 1,
+    SUPPORT_BPTC = 2
+};
+
+struct CompressedLevel
+{
+    int Width;
+    int Height;
+    size_t Offset;
+    size_t Size;
+};
+
+// a complete mip chain in one GL compressed internal format, levels stored back to back
+struct CompressedImage
+{
+    GLenum InternalFormat = 0;
+    std::vector<CompressedLevel> Levels;
+    std::vector<unsigned char> Data;
+};
+
+// CPU encoders for the BCn formats, run once per texture on a loader thread; the result
+// is cached in a KTX file (see KtxCache.h), so encode speed matters far less than the
+// upload and sampling savings. The encoders fit endpoints along the principal axis of
+// each 4x4 block and then pick the nearest palette entry per pixel.
+class TextureCompressor
+{
+public:
+    static unsigned int QuerySupport()
+    {
+        unsigned int support = 0;
+        if (HasGLExtension("GL_EXT_texture_compression_s3tc"))
+            support |= SUPPORT_S3TC;
+        if (HasGLVersion(4, 2) || HasGLExtension("GL_ARB_texture_compression_bptc"))
+            support |= SUPPORT_BPTC;
+        return support;
+    }
+
+    // BC4 for one channel, BC5 for two, BC1 for RGB and BC7 (or BC3 without BPTC) for
+    // RGBA; 0 when nothing suitable is supported
+    static GLenum ChooseFormat(int components, unsigned int support)
+    {
+        switch (components)
+        {
+        case 1: return GL_COMPRESSED_RED_RGTC1;
+        case 2: return GL_COMPRESSED_RG_RGTC2;
+        case 3:
+            if (support & SUPPORT_S3TC)
+                return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            return (support & SUPPORT_BPTC) ? GL_COMPRESSED_RGBA_BPTC_UNORM : 0;
+        case 4:
+            if (support & SUPPORT_BPTC)
+                return GL_COMPRESSED_RGBA_BPTC_UNORM;
+            return (support & SUPPORT_S3TC) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+        default: return 0;
+        }
+    }
+
+    static bool IsSupported(GLenum format, unsigned int support)
+    {
+        switch (format)
+        {
+        case GL_COMPRESSED_RED_RGTC1:
+        case GL_COMPRESSED_RG_RGTC2: return true;
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return (support & SUPPORT_S3TC) != 0;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: return (support & SUPPORT_BPTC) != 0;
+        default: return false;
+        }
+    }
+
+    static size_t BlockBytes(GLenum format)
+    {
+        return (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1) ? 8 : 16;
+    }
+
+    static size_t LevelSize(GLenum format, int width, int height)
+    {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+    }
+
+    // builds the box filtered mip chain down to 1x1 and encodes every level
+    static bool Compress(const unsigned char* pixels, int width, int height, int components, GLenum format, CompressedImage& image)
+    {
+        if (!pixels || width <= 0 || height <= 0 || components < 1 || components > 4 || !format)
+            return false;
+        image.InternalFormat = format;
+        image.Levels.clear();
+        image.Data.clear();
+
+        std::vector<unsigned char> level(pixels, pixels + static_cast<size_t>(width) * height * components);
+        for (;;)
+        {
+            CompressedLevel info = { width, height, image.Data.size(), LevelSize(format, width, height) };
+            image.Data.resize(info.Offset + info.Size);
+            encodeLevel(level.data(), width, height, components, format, image.Data.data() + info.Offset);
+            image.Levels.push_back(info);
+            if (width == 1 && height == 1)
+                break;
+            level = downsample(level, width, height, components);
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+        }
+        return true;
+    }
+
+private:
+    typedef unsigned char Block[16][4];
+
+    static std::vector<unsigned char> downsample(const std::vector<unsigned char>& source, int width, int height, int components)
+    {
+        int nextWidth = std::max(1, width / 2);
+        int nextHeight = std::max(1, height / 2);
+        std::vector<unsigned char> result(static_cast<size_t>(nextWidth) * nextHeight * components);
+        for (int y = 0; y < nextHeight; ++y)
+        {
+            int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+            for (int x = 0; x < nextWidth; ++x)
+            {
+                int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                for (int c = 0; c < components; ++c)
+                {
+                    int sum = source[(static_cast<size_t>(y0) * width + x0) * components + c]
+                        + source[(static_cast<size_t>(y0) * width + x1) * components + c]
+                        + source[(static_cast<size_t>(y1) * width + x0) * components + c]
+                        + source[(static_cast<size_t>(y1) * width + x1) * components + c];
+                    result[(static_cast<size_t>(y) * nextWidth + x) * components + c] = static_cast<unsigned char>((sum + 2) / 4);
+                }
+            }
+        }
+        return result;
+    }
+
+    static void encodeLevel(const unsigned char* pixels, int width, int height, int components, GLenum format, unsigned char* out)
+    {
+        size_t blockBytes = BlockBytes(format);
+        for (int by = 0; by < height; by += 4)
+        {
+            for (int bx = 0; bx < width; bx += 4)
+            {
+                Block block;
+                fetchBlock(pixels, width, height, components, bx, by, block);
+                switch (format)
+                {
+                case GL_COMPRESSED_RED_RGTC1:
+                    encodeBC4(block, 0, out);
+                    break;
+                case GL_COMPRESSED_RG_RGTC2:
+                    encodeBC4(block, 0, out);
+                    encodeBC4(block, 1, out + 8);
+                    break;
+                case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+                    encodeBC1(block, out);
+                    break;
+                case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+                    encodeBC4(block, 3, out);
+                    encodeBC1(block, out + 8);
+                    break;
+                case GL_COMPRESSED_RGBA_BPTC_UNORM:
+                    encodeBC7(block, out);
+                    break;
+                }
+                out += blockBytes;
+            }
+        }
+    }
+
+    // 4x4 texels as RGBA, edges clamped; missing channels read as 0 and alpha as 255
+    static void fetchBlock(const unsigned char* pixels, int width, int height, int components, int bx, int by, Block block)
+    {
+        for (int i = 0; i < 16; ++i)
+        {
+            int x = std::min(bx + (i & 3), width - 1);
+            int y = std::min(by + (i >> 2), height - 1);
+            const unsigned char* texel = pixels + (static_cast<size_t>(y) * width + x) * components;
+            block[i][0] = texel[0];
+            block[i][1] = components > 1 ? texel[1] : 0;
+            block[i][2] = components > 2 ? texel[2] : 0;
+            block[i][3] = components > 3 ? texel[3] : 255;
+        }
+    }
+
+    // endpoints of the block's extent along its principal axis over the first `channels` channels
+    static void fitEndpoints(const Block block, int channels, float low[4], float high[4])
+    {
+        float mean[4] = {};
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < channels; ++c)
+                mean[c] += block[i][c] / 16.0f;
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; ++i)
+            for (int a = 0; a < channels; ++a)
+                for (int b = 0; b < channels; ++b)
+                    covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+        // power iteration, started on the diagonal of the bounding box
+        float axis[4] = {};
+        for (int c = 0; c < channels; ++c)
+        {
+            unsigned char lo = 255, hi = 0;
+            for (int i = 0; i < 16; ++i)
+            {
+                lo = std::min(lo, block[i][c]);
+                hi = std::max(hi, block[i][c]);
+            }
+            axis[c] = static_cast<float>(hi - lo);
+        }
+        for (int iteration = 0; iteration < 8; ++iteration)
+        {
+            float next[4] = {};
+            float length = 0.0f;
+            for (int a = 0; a < channels; ++a)
+            {
+                for (int b = 0; b < channels; ++b)
+                    next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::fabs(next[a]));
+            }
+            if (length <= 0.0f)
+                break;
+            for (int c = 0; c < channels; ++c)
+                axis[c] = next[c] / length;
+        }
+
+        float norm = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            norm += axis[c] * axis[c];
+        float minProjection = 0.0f, maxProjection = 0.0f;
+        if (norm > 0.0f)
+        {
+            for (int c = 0; c < channels; ++c)
+                axis[c] /= std::sqrt(norm);
+            minProjection = 1e30f;
+            maxProjection = -1e30f;
+            for (int i = 0; i < 16; ++i)
+            {
+                float projection = 0.0f;
+                for (int c = 0; c < channels; ++c)
+                    projection += (block[i][c] - mean[c]) * axis[c];
+                minProjection = std::min(minProjection, projection);
+                maxProjection = std::max(maxProjection, projection);
+            }
+        }
+        for (int c = 0; c < 4; ++c)
+        {
+            low[c] = c < channels ? std::clamp(mean[c] + axis[c] * minProjection, 0.0f, 255.0f) : 255.0f;
+            high[c] = c < channels ? std::clamp(mean[c] + axis[c] * maxProjection, 0.0f, 255.0f) : 255.0f;
+        }
+    }
+
+    static int squaredDistance(const unsigned char* a, const int* b, int channels)
+    {
+        int distance = 0;
+        for (int c = 0; c < channels; ++c)
+            distance += (a[c] - b[c]) * (a[c] - b[c]);
+        return distance;
+    }
+
+    static uint16_t packRGB565(const float color[4])
+    {
+        int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+        int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+        int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    static void unpackRGB565(uint16_t packed, int color[4])
+    {
+        int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+        color[3] = 255;
+    }
+
+    // BC1 color block in four color mode (color0 > color1), also the color half of BC3
+    static void encodeBC1(const Block block, unsigned char* out)
+    {
+        float low[4], high[4];
+        fitEndpoints(block, 3, low, high);
+        uint16_t color0 = packRGB565(high);
+        uint16_t color1 = packRGB565(low);
+        if (color0 < color1)
+            std::swap(color0, color1);
+
+        uint32_t indices = 0;
+        if (color0 != color1)
+        {
+            int palette[4][4];
+            unpackRGB565(color0, palette[0]);
+            unpackRGB565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestDistance = squaredDistance(block[i], palette[0], 3);
+                for (int p = 1; p < 4; ++p)
+                {
+                    int distance = squaredDistance(block[i], palette[p], 3);
+                    if (distance < bestDistance)
+                    {
+                        best = p;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= static_cast<uint32_t>(best) << (2 * i);
+            }
+        }
+        out[0] = color0 & 0xFF;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xFF;
+        out[3] = color1 >> 8;
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+
+    // BC4 single channel block in eight value mode (value0 > value1), also the alpha half of BC3
+    static void encodeBC4(const Block block, int channel, unsigned char* out)
+    {
+        int value0 = 0, value1 = 255;
+        for (int i = 0; i < 16; ++i)
+        {
+            value0 = std::max<int>(value0, block[i][channel]);
+            value1 = std::min<int>(value1, block[i][channel]);
+        }
+
+        uint64_t indices = 0;
+        if (value0 != value1)
+        {
+            int palette[8] = { value0, value1 };
+            for (int p = 1; p < 7; ++p)
+                palette[p + 1] = ((7 - p) * value0 + p * value1) / 7;
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestDistance = 256;
+                for (int p = 0; p < 8; ++p)
+                {
+                    int distance = std::abs(block[i][channel] - palette[p]);
+                    if (distance < bestDistance)
+                    {
+                        best = p;
+                        bestDistance = distance;
+                    }
+                }
+                indices |= static_cast<uint64_t>(best) << (3 * i);
+            }
+        }
+        out[0] = static_cast<unsigned char>(value0);
+        out[1] = static_cast<unsigned char>(value1);
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+
+    // BC7 mode 6 only: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices
+    static void encodeBC7(const Block block, unsigned char* out)
+    {
+        static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        float ends[2][4];
+        fitEndpoints(block, 4, ends[0], ends[1]);
+
+        // quantize each endpoint with whichever p-bit lands closer
+        int quantized[2][4], pbits[2];
+        for (int e = 0; e < 2; ++e)
+        {
+            float bestError = 1e30f;
+            for (int p = 0; p < 2; ++p)
+            {
+                int candidate[4];
+                float error = 0.0f;
+                for (int c = 0; c < 4; ++c)
+                {
+                    candidate[c] = std::clamp(static_cast<int>(std::lround((ends[e][c] - p) / 2.0f)), 0, 127);
+                    float difference = static_cast<float>((candidate[c] << 1) | p) - ends[e][c];
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    pbits[e] = p;
+                    std::memcpy(quantized[e], candidate, sizeof(candidate));
+                }
+            }
+        }
+
+        int palette[16][4];
+        for (int c = 0; c < 4; ++c)
+        {
+            int e0 = (quantized[0][c] << 1) | pbits[0];
+            int e1 = (quantized[1][c] << 1) | pbits[1];
+            for (int i = 0; i < 16; ++i)
+                palette[i][c] = ((64 - weights[i]) * e0 + weights[i] * e1 + 32) >> 6;
+        }
+        int indices[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            int best = 0, bestDistance = squaredDistance(block[i], palette[0], 4);
+            for (int p = 1; p < 16; ++p)
+            {
+                int distance = squaredDistance(block[i], palette[p], 4);
+                if (distance < bestDistance)
+                {
+                    best = p;
+                    bestDistance = distance;
+                }
+            }
+            indices[i] = best;
+        }
+        // the first index is stored with 3 bits, so its top bit must be clear
+        if (indices[0] & 8)
+        {
+            std::swap(quantized[0], quantized[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (int i = 0; i < 16; ++i)
+                indices[i] = 15 - indices[i];
+        }
+
+        std::memset(out, 0, 16);
+        int bit = 0;
+        auto write = [&](int value, int count)
+        {
+            for (int i = 0; i < count; ++i, ++bit)
+                out[bit >> 3] |= ((value >> i) & 1) << (bit & 7);
+        };
+        write(1 << 6, 7);
+        for (int c = 0; c < 4; ++c)
+        {
+            write(quantized[0][c], 7);
+            write(quantized[1][c], 7);
+        }
+        write(pbits[0], 1);
+        write(pbits[1], 1);
+        write(indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+            write(indices[i], 4);
+    }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "stb_image.h"
+#include "ThreadPool.h"
+#include "TextureCompressor.h"
+#include "KtxCache.h"
+#include "GLState.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// bytes of decoded pixels uploaded per Update call; one texture always goes through
+// so a single image larger than the budget still gets uploaded
+const size_t TEXTURE_UPLOAD_BUDGET = 16 * 1024 * 1024;
+
+// Streams textures in without blocking the render thread: Load returns a texture name
+// right away, backed by a 1x1 placeholder, while the file is decoded on the shared
+// ThreadPool. Update, called once per frame on the GL thread, uploads finished images
+// through a pixel buffer object into the same texture name, so handles never change.
+// With Compress set, images go through the BCn cache of KtxCache.h and are uploaded
+// with glCompressedTexImage2D including their stored mip chain.
+class TextureLoader
+{
+public:
+    bool Compress = true;
+
+    static TextureLoader& Shared()
+    {
+        static TextureLoader loader;
+        return loader;
+    }
+
+    unsigned int Load(const std::string& path, bool flipVertically = true)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glState.BindTextureForUpdate(textureID);
+        // mid grey until the real image is resident
+        const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        if (Compress && !supportQueried)
+        {
+            compressionSupport = TextureCompressor::QuerySupport();
+            supportQueried = true;
+        }
+        bool compress = Compress;
+        unsigned int support = compressionSupport;
+
+        PendingTexture pending;
+        pending.Texture = textureID;
+        pending.Path = path;
+        pending.Image = ThreadPool::Shared().Submit([path, flipVertically, compress, support] {
+            return decode(path, flipVertically, compress, support);
+        });
+        pendingTextures.push_back(std::move(pending));
+        return textureID;
+    }
+
+    // uploads decoded images until budgetBytes is spent, returns the number uploaded
+    unsigned int Update(size_t budgetBytes = TEXTURE_UPLOAD_BUDGET)
+    {
+        unsigned int uploaded = 0;
+        size_t spent = 0;
+        for (size_t i = 0; i < pendingTextures.size() && (uploaded == 0 || spent < budgetBytes); )
+        {
+            PendingTexture& pending = pendingTextures[i];
+            if (pending.Image.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                ++i;
+                continue;
+            }
+            spent += upload(pending);
+            ++uploaded;
+            pendingTextures.erase(pendingTextures.begin() + i);
+        }
+        return uploaded;
+    }
+
+    // blocks until every requested texture is resident, e.g. before a benchmark run
+    void Finish()
+    {
+        while (!pendingTextures.empty())
+        {
+            pendingTextures.front().Image.wait();
+            Update(SIZE_MAX);
+        }
+    }
+
+    size_t Pending() const
+    {
+        return pendingTextures.size();
+    }
+
+    // true until the image of a texture returned by Load has been uploaded
+    bool IsPending(unsigned int texture) const
+    {
+        for (const PendingTexture& pending : pendingTextures)
+            if (pending.Texture == texture)
+                return true;
+        return false;
+    }
+
+private:
+    struct DecodedImage
+    {
+        std::unique_ptr<unsigned char, void (*)(void*)> Pixels{ nullptr, stbi_image_free };
+        int Width = 0;
+        int Height = 0;
+        int Components = 0;
+        // used instead of Pixels when InternalFormat is set
+        CompressedImage Compressed;
+    };
+
+    struct PendingTexture
+    {
+        unsigned int Texture;
+        std::string Path;
+        std::future<DecodedImage> Image;
+    };
+
+    std::vector<PendingTexture> pendingTextures;
+    unsigned int pixelBuffer = 0;
+    unsigned int compressionSupport = 0;
+    bool supportQueried = false;
+
+    TextureLoader() = default;
+    // GL objects are left to the context: the shared loader outlives it
+
+    // runs on a worker thread; the flip flag is per thread so concurrent decodes don't race on it
+    static DecodedImage decode(const std::string& path, bool flipVertically, bool compress, unsigned int support)
+    {
+        DecodedImage image;
+        std::string stamp = compress ? KtxCache::SourceStamp(path, flipVertically) : std::string();
+        if (!stamp.empty() && KtxCache::Load(path, stamp, support, image.Compressed))
+            return image;
+
+        stbi_set_flip_vertically_on_load_thread(flipVertically);
+        image.Pixels.reset(stbi_load(path.c_str(), &image.Width, &image.Height, &image.Components, 0));
+        if (!stamp.empty() && image.Pixels)
+        {
+            GLenum format = TextureCompressor::ChooseFormat(image.Components, support);
+            if (TextureCompressor::Compress(image.Pixels.get(), image.Width, image.Height, image.Components, format, image.Compressed))
+            {
+                if (!KtxCache::Save(path, stamp, image.Compressed))
+                    std::cout << "ERROR::TEXTURE::KTX_CACHE_WRITE_FAILED " << KtxCache::PathFor(path) << std::endl;
+                image.Pixels.reset();
+            }
+        }
+        return image;
+    }
+
+    size_t uploadCompressed(PendingTexture& pending, const CompressedImage& image)
+    {
+        size_t size = image.Data.size();
+        if (pixelBuffer == 0)
+            glGenBuffers(1, &pixelBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped)
+        {
+            std::memcpy(mapped, image.Data.data(), size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glState.BindTextureForUpdate(pending.Texture);
+        for (unsigned int level = 0; level < image.Levels.size(); ++level)
+        {
+            const CompressedLevel& info = image.Levels[level];
+            // an offset into the unpack buffer when it's bound
+            const unsigned char* data = mapped ? (const unsigned char*)0 + info.Offset : image.Data.data() + info.Offset;
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, image.InternalFormat, info.Width, info.Height, 0,
+                static_cast<GLsizei>(info.Size), data);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(image.Levels.size()) - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return size;
+    }
+
+    size_t upload(PendingTexture& pending)
+    {
+        DecodedImage image = pending.Image.get();
+        if (image.Compressed.InternalFormat)
+            return uploadCompressed(pending, image.Compressed);
+        if (!image.Pixels)
+        {
+            std::cout << "Texture failed to load at path: " << pending.Path << std::endl;
+            return 0;
+        }
+
+        GLenum format;
+        if (image.Components == 1)
+            format = GL_RED;
+        else if (image.Components == 3)
+            format = GL_RGB;
+        else if (image.Components == 4)
+            format = GL_RGBA;
+        else
+        {
+            std::cout << "Unsuported number of components" << std::endl;
+            return 0;
+        }
+
+        size_t size = static_cast<size_t>(image.Width) * image.Height * image.Components;
+        if (pixelBuffer == 0)
+            glGenBuffers(1, &pixelBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+        // respecifying the store orphans the previous upload's memory instead of waiting for it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+        glState.BindTextureForUpdate(pending.Texture);
+        if (mapped)
+        {
+            std::memcpy(mapped, image.Pixels.get(), size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            // with the unpack buffer bound the data pointer is an offset into it
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.Width, image.Height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        else
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glTexImage2D(GL_TEXTURE_2D, 0, format, image.Width, image.Height, 0, format, GL_UNSIGNED_BYTE, image.Pixels.get());
+        }
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        return size;
+    }
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm.hpp>
+
+#include <string_view>
+
+// Binding points of the uniform blocks shared by every program. Shader binds blocks
+// with these names to the matching point right after linking (GLSL 330 has no
+// layout(binding = N) for blocks).
+enum UniformBlockBinding {
+    FRAME_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1
+};
+
+inline int uniformBlockBinding(std::string_view blockName)
+{
+    if (blockName == "Frame")
+        return FRAME_BLOCK_BINDING;
+    if (blockName == "Lights")
+        return LIGHTS_BLOCK_BINDING;
+    return -1;
+}
+
+// CPU mirrors of the std140 blocks declared in the shaders. Every vec3 is followed by
+// a float so each pair fills one 16 byte std140 slot; keep the member order in sync
+// with the GLSL declarations.
+
+// uniform Frame in every vertex shader
+struct FrameBlock
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPos;
+};
+
+struct DirLightData
+{
+    glm::vec3 direction; float pad0;
+    glm::vec3 ambient;   float pad1;
+    glm::vec3 diffuse;   float pad2;
+    glm::vec3 specular;  float pad3;
+};
+
+struct PointLightData
+{
+    glm::vec3 position; float constant;
+    glm::vec3 ambient;  float linear;
+    glm::vec3 diffuse;  float quadratic;
+    glm::vec3 specular; float pad0;
+};
+
+struct SpotLightData
+{
+    glm::vec3 position;  float cutOff;
+    glm::vec3 direction; float outerCutOff;
+    glm::vec3 ambient;   float constant;
+    glm::vec3 diffuse;   float linear;
+    glm::vec3 specular;  float quadratic;
+};
+
+// must match MAX_POINT_LIGHTS in FragmentShader.frag
+const unsigned int MAX_POINT_LIGHTS = 16;
+
+// uniform Lights in FragmentShader.frag
+struct LightsBlock
+{
+    DirLightData dirLight;
+    SpotLightData spotLight;
+    PointLightData pointLights[MAX_POINT_LIGHTS];
+    int pointLightCount;
+    int pad[3];
+};
+
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock must match the std140 layout");
+static_assert(sizeof(DirLightData) == 64 && sizeof(PointLightData) == 64 && sizeof(SpotLightData) == 80,
+    "light structs must match the std140 layout");
+static_assert(sizeof(LightsBlock) == 64 + 80 + 64 * MAX_POINT_LIGHTS + 16, "LightsBlock must match the std140 layout");
+
+// A uniform buffer attached to a fixed binding point and refreshed with one upload.
+class UniformBuffer
+{
+public:
+    unsigned int ID = 0;
+
+    UniformBuffer(GLsizeiptr size, unsigned int binding)
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~UniformBuffer()
+    {
+        glDeleteBuffers(1, &ID);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    void Update(const void* data, GLsizeiptr size, GLintptr offset = 0)
+    {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    template <typename T>
+    void Update(const T& data)
+    {
+        Update(&data, sizeof(T));
+    }
+};
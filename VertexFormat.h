@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <glm.hpp>
+#include <gtc/packing.hpp>
+
+#include "Mesh.h"
+#include "Bounds.h"
+
+#include <cmath>
+#include <cstdint>
+
+// Layouts a Model can keep its vertex buffer in. Meshes are always imported and cached
+// as float Vertex; the packed layout is produced when the buffer is uploaded.
+enum VertexFormat
+{
+    VERTEX_FORMAT_FLOAT,
+    VERTEX_FORMAT_PACKED
+};
+
+// 16 bytes instead of the 32 of Vertex. The shaders undo the position quantization with
+// the positionOffset/positionScale uniforms and decode the normal when octahedralNormals
+// is set; half float UVs need no decoding.
+struct PackedVertex
+{
+    // unorm16 within the quantization bounds, the fourth is padding
+    uint16_t Position[4];
+    // octahedral, snorm16
+    int16_t Normal[2];
+    uint16_t TexCoords[2];
+};
+
+class VertexPacker
+{
+public:
+    static PackedVertex Pack(const Vertex& vertex, const Bounds& bounds)
+    {
+        PackedVertex packed;
+        glm::vec3 extent = bounds.Max - bounds.Min;
+        for (int i = 0; i < 3; ++i)
+        {
+            float unit = extent[i] > 0.0f ? (vertex.Position[i] - bounds.Min[i]) / extent[i] : 0.0f;
+            packed.Position[i] = glm::packUnorm1x16(unit);
+        }
+        packed.Position[3] = 0;
+
+        glm::vec2 octahedral = EncodeOctahedral(vertex.Normal);
+        packed.Normal[0] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.x));
+        packed.Normal[1] = static_cast<int16_t>(glm::packSnorm1x16(octahedral.y));
+
+        packed.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        packed.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+        return packed;
+    }
+
+    // unit vector to the [-1, 1] square: project onto the octahedron, fold the lower half over
+    static glm::vec2 EncodeOctahedral(const glm::vec3& normal)
+    {
+        float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        if (sum == 0.0f)
+            return glm::vec2(0.0f);
+        glm::vec2 encoded(normal.x / sum, normal.y / sum);
+        if (normal.z < 0.0f)
+        {
+            glm::vec2 folded(1.0f - std::fabs(encoded.y), 1.0f - std::fabs(encoded.x));
+            encoded.x = encoded.x >= 0.0f ? folded.x : -folded.x;
+            encoded.y = encoded.y >= 0.0f ? folded.y : -folded.y;
+        }
+        return encoded;
+    }
+
+    // attribute locations 0-2 of the bound VAO and array buffer, matching the model shaders
+    static void SetupAttributes(VertexFormat format)
+    {
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        if (format == VERTEX_FORMAT_PACKED)
+        {
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+            // the shader reads a vec3 and decodes xy, z comes in as 0
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoords));
+        }
+        else
+        {
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        }
+    }
+
+    static size_t Stride(VertexFormat format)
+    {
+        return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+    }
+};
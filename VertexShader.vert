@@ -2,21 +2,29 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+// per instance, see InstanceBuffer.h
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 normalMatrix;
+layout (std140) uniform Frame
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPos;
+};
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+// the shading pass tests GL_EQUAL against the depth pre-pass, which runs this shader too
+invariant gl_Position;
 
 void main()
 {
-    mat4 modelView = view * model;
+    mat4 modelView = view * aModel;
     FragPos = vec3(modelView * vec4(aPos, 1.0f));
-    Normal = mat3(normalMatrix) * aNormal;
+    // view has no scale, so its rotation part carries world space normals into view space
+    Normal = mat3(view) * (aNormalMatrix * aNormal);
     TexCoords = aTexCoords;
     gl_Position = projection * vec4(FragPos, 1.0f);
 } 
\ No newline at end of file
@@ -23,7 +23,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <glad/glad.h>
+#ifndef LEARNOPENGL_HEADLESS
 #include <GLFW/glfw3.h>
+#endif
 
 static void* get_proc(const char* namez);
 